@@ -0,0 +1,90 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "RTWeekend.hpp"
+
+#include <utility>
+
+// Axis-Aligned Bounding Box
+class AABB {
+  public:
+    // CONSTRUCTORS //
+    AABB() {}
+    AABB(const Point3& a, const Point3& b) : minimum(a), maximum(b) {}
+
+    // ACCESSORS //
+    Point3 min() const {
+      return minimum;
+    }
+
+    Point3 max() const {
+      return maximum;
+    }
+
+    // METHODS //
+
+    // does the ray pass through the box within [t_min, t_max] ?
+    bool hit(const Ray& r, double t_min, double t_max) const {
+      // intersect the ray with the slab between the two planes of each axis,
+      // narrowing down [t_min, t_max] as we go
+      for (int a = 0; a < 3; ++a) {
+        auto inv_d = 1.0 / r.direction()[a];
+        auto t0 = (minimum[a] - r.origin()[a]) * inv_d;
+        auto t1 = (maximum[a] - r.origin()[a]) * inv_d;
+        // a negative direction enters through the max plane
+        if (inv_d < 0.0) {
+          std::swap(t0, t1);
+        }
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max <= t_min) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // surface area of the box, the cost of a box in the Surface Area Heuristic
+    double surface_area() const {
+      auto d = maximum - minimum;
+      return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    // the axis along which the box is longest
+    int longest_axis() const {
+      auto d = maximum - minimum;
+      if (d.x() > d.y() && d.x() > d.z()) {
+        return 0;
+      }
+      return d.y() > d.z() ? 1 : 2;
+    }
+
+    bool operator==(const AABB& other) const {
+      for (int a = 0; a < 3; ++a) {
+        if (minimum[a] != other.minimum[a] || maximum[a] != other.maximum[a]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  // FIELDS //
+  public:
+    Point3 minimum;
+    Point3 maximum;
+};
+
+// the smallest box containing both boxes
+inline AABB surrounding_box(const AABB& box0, const AABB& box1) {
+  Point3 small(fmin(box0.min().x(), box1.min().x()),
+               fmin(box0.min().y(), box1.min().y()),
+               fmin(box0.min().z(), box1.min().z()));
+
+  Point3 big(fmax(box0.max().x(), box1.max().x()),
+             fmax(box0.max().y(), box1.max().y()),
+             fmax(box0.max().z(), box1.max().z()));
+
+  return AABB(small, big);
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Monotonic arena: objects are bump-allocated, back to back, from one big
+// block of memory, and are only ever freed all at once when the arena goes.
+//
+// All of the arena's own bookkeeping (the chain of blocks, and the list of
+// destructors to run) lives in the blocks themselves. The destructor records
+// are taken from the top end of a block, while objects grow from the bottom
+// end, so the objects stay back to back.
+//
+// When the size of everything is known up front (see `reserve` and
+// `footprint`), the whole arena is a single allocation, and tearing it down a
+// single free. Otherwise it grows by chaining further blocks.
+class Arena {
+  public:
+    // CONSTRUCTORS //
+    Arena() {}
+
+    ~Arena() {
+      clear();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // METHODS //
+
+    // upper bound on the arena space taken by one `create<T>`
+    template <class T>
+    static constexpr size_t footprint() {
+      return sizeof(T) + alignof(T)
+        + (std::is_trivially_destructible<T>::value ? 0 : sizeof(dtor) + alignof(dtor));
+    }
+
+    // make sure the next `bytes` worth of objects fit in the current block
+    void reserve(size_t bytes) {
+      if (top - used < bytes) {
+        new_block(bytes);
+      }
+    }
+
+    // `size` bytes aligned to `align`, valid until the arena goes
+    void* allocate(size_t size, size_t align) {
+      size_t start = (used + align - 1) & ~(align - 1);
+      if (!current || start + size > top) {
+        grow(size + align);
+        start = (used + align - 1) & ~(align - 1);
+      }
+      used = start + size;
+      return current + start;
+    }
+
+    // construct a `T` in the arena
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+      // only objects which need it get their destructor run on teardown
+      dtor* d = nullptr;
+      if (!std::is_trivially_destructible<T>::value) {
+        d = allocate_dtor(sizeof(T) + alignof(T));
+      }
+
+      void* mem = allocate(sizeof(T), alignof(T));
+      T* obj = new (mem) T(std::forward<Args>(args)...);
+
+      if (d) {
+        *d = { obj, [](void* p) { static_cast<T*>(p)->~T(); }, dtors };
+        dtors = d;
+      }
+      return obj;
+    }
+
+    // destroy all objects (newest first) and free all blocks
+    void clear() {
+      for (auto d = dtors; d; d = d->next) {
+        d->destroy(d->obj);
+      }
+      dtors = nullptr;
+
+      while (current) {
+        auto prev = reinterpret_cast<block_header*>(current)[-1].prev;
+        free(current - sizeof(block_header));
+        current = prev;
+      }
+      used = top = cap = 0;
+      allocated = 0;
+      blocks = 0;
+    }
+
+    // ACCESSORS //
+
+    // bytes allocated from the system, and in how many blocks
+    size_t bytes_allocated() const {
+      return allocated;
+    }
+
+    size_t n_blocks() const {
+      return blocks;
+    }
+
+  private:
+    // destructor to run on teardown
+    struct dtor {
+      void* obj;
+      void (*destroy)(void*);
+      dtor* next;
+    };
+
+    // sits right in front of every block, chaining it to the previous one
+    struct alignas(std::max_align_t) block_header {
+      char* prev;
+    };
+
+    // a destructor record from the top of the current block, leaving room
+    // for an object of `room` bytes after it
+    dtor* allocate_dtor(size_t room) {
+      size_t start = (top - sizeof(dtor)) & ~(alignof(dtor) - 1);
+      if (!current || top < sizeof(dtor) || start < used + room) {
+        grow(sizeof(dtor) + alignof(dtor) + room);
+        start = (top - sizeof(dtor)) & ~(alignof(dtor) - 1);
+      }
+      top = start;
+      return reinterpret_cast<dtor*>(current + start);
+    }
+
+    // start a new block with room for at least `bytes`; blocks grow
+    // geometrically, so that many small objects don't each get their own
+    void grow(size_t bytes) {
+      new_block(bytes > 2 * cap ? bytes : 2 * cap);
+    }
+
+    void new_block(size_t bytes) {
+      // malloc'd memory (and so the block after its header) is aligned for
+      // any fundamental type
+      auto mem = static_cast<char*>(malloc(sizeof(block_header) + bytes));
+      if (!mem) {
+        throw std::bad_alloc();
+      }
+      reinterpret_cast<block_header*>(mem)->prev = current;
+
+      current = mem + sizeof(block_header);
+      used = 0;
+      top = cap = bytes;
+      allocated += sizeof(block_header) + bytes;
+      ++blocks;
+    }
+
+  // FIELDS //
+  private:
+    char* current = nullptr;  // the newest block
+    size_t used = 0;          // bytes used for objects of the newest block
+    size_t top = 0;           // start of its destructor records
+    size_t cap = 0;           // size of the newest block
+    size_t allocated = 0;     // size of all blocks, with their headers
+    size_t blocks = 0;
+    dtor* dtors = nullptr;    // newest first
+};
+
+// A non-owning `shared_ptr` to an arena object: it has no control block, so
+// copying it (e.g. into every `hit_record`) costs no reference counting. It
+// must not outlive the arena.
+template <class T>
+std::shared_ptr<T> arena_ptr(T* obj) {
+  return std::shared_ptr<T>(std::shared_ptr<void>(), obj);
+}
+
+#endif
@@ -0,0 +1,440 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "RTWeekend.hpp"
+
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "Hittable_List.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Bounding Volume Hierarchy over a set of (bounded) `Hittable`s.
+//
+// The tree is a flat array of nodes with parent links, holding one object per
+// leaf, so that it can be edited in place: `insert`, `remove`, and `update`
+// (after an object has moved or changed size) only refit the boxes on the way
+// from the touched leaf up to the root, which costs O(depth) rather than a
+// rebuild of the whole tree.
+//
+// Refitting keeps the tree correct but not good: boxes of moved objects may
+// end up overlapping a lot, and a ray entering one of them then has to look
+// into both. So that is what's tracked: how much of each internal node's box
+// its two children share, on average over the tree. Once that has grown by
+// `rebuild_overlap` since the last build, the tree is rebuilt from scratch.
+//
+// (The tree's SAH cost, which weighs the nodes by area, doesn't work for
+// this: in a scene with one huge object, like the ground sphere, the nodes
+// above it outweigh everything else, and it hardly moves however badly the
+// rest of the tree degrades.)
+class BVH : public Hittable {
+  public:
+    // CONSTRUCTORS //
+    BVH() {}
+
+    // build a BVH over all the objects of `list`
+    BVH(const Hittable_List& list) {
+      for (const auto& object : list.objects) {
+        objects.push_back(object);
+        leaf_of.push_back(-1);
+      }
+      rebuild();
+    }
+
+    // OBJECT MGMT //
+
+    // Add `object` to the tree, returning its handle. The handles of removed
+    // objects are reused.
+    int insert(shared_ptr<Hittable> object) {
+      int handle;
+      if (!free_handles.empty()) {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        objects[handle] = object;
+      }
+      else {
+        handle = static_cast<int>(objects.size());
+        objects.push_back(object);
+        leaf_of.push_back(-1);
+      }
+
+      int leaf = new_leaf(handle);
+      insert_leaf(leaf);
+      maybe_rebuild();
+      return handle;
+    }
+
+    // Remove the object with the given handle from the tree
+    void remove(int handle) {
+      remove_leaf(leaf_of[handle]);
+      free_node(leaf_of[handle]);
+      leaf_of[handle] = -1;
+      objects[handle] = nullptr;
+      free_handles.push_back(handle);
+      maybe_rebuild();
+    }
+
+    // The object with the given handle moved or changed size: refit its box
+    // and those of its ancestors
+    void update(int handle) {
+      int leaf = leaf_of[handle];
+      objects[handle]->bounding_box(nodes[leaf].box);
+      refit(nodes[leaf].parent);
+      maybe_rebuild();
+    }
+
+    // (re)build the whole tree from the current objects
+    void rebuild() {
+      nodes.clear();
+      free_nodes.clear();
+      internal_area = 0;
+      internal_overlap = 0;
+      root = -1;
+
+      std::vector<int> handles;
+      for (int h = 0; h < static_cast<int>(objects.size()); ++h) {
+        if (objects[h]) {
+          handles.push_back(h);
+        }
+      }
+
+      if (!handles.empty()) {
+        root = build(handles, 0, handles.size(), -1);
+      }
+      built_overlap = overlap();
+      ++rebuilds;
+    }
+
+    // ACCESSORS //
+
+    shared_ptr<Hittable> object(int handle) const {
+      return objects[handle];
+    }
+
+    // handles of all objects, in the order a depth-first traversal reaches
+    // their leaves
+    std::vector<int> leaf_order() const {
+      std::vector<int> order;
+      std::vector<int> stack;
+      if (root >= 0) {
+        stack.push_back(root);
+      }
+      while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        if (nodes[n].object >= 0) {
+          order.push_back(nodes[n].object);
+        }
+        else {
+          // left first, as in `hit`
+          stack.push_back(nodes[n].right);
+          stack.push_back(nodes[n].left);
+        }
+      }
+      return order;
+    }
+
+    // SAH cost of the tree: the expected number of internal nodes a ray
+    // through the root's box visits
+    double cost() const {
+      if (root < 0 || nodes[root].object >= 0) {
+        return 0;
+      }
+      auto root_area = nodes[root].box.surface_area();
+      return root_area > 0 ? internal_area / root_area : 0;
+    }
+
+    // the average share of an internal node's box (by area) which its two
+    // children's boxes overlap in: 0 for a tree whose children are apart,
+    // up to 1 for one whose children all cover the same space
+    double overlap() const {
+      int n_internal = static_cast<int>(objects.size() - free_handles.size()) - 1;
+      return n_internal > 0 ? internal_overlap / n_internal : 0;
+    }
+
+    // the number of times the tree has been (re)built
+    int rebuild_count() const {
+      return rebuilds;
+    }
+
+    // METHODS //
+    virtual bool hit(
+        const Ray& r, double t_min, double t_max, hit_record& rec) const override {
+      return hit_with(r, t_min, t_max, rec,
+          [this](int h, const Ray& r, double t_min, double t_max, hit_record& rec) {
+            return objects[h]->hit(r, t_min, t_max, rec);
+          });
+    }
+
+    // Closest-hit traversal, testing the objects with
+    // `leaf_hit(handle, r, t_min, t_max, rec)` rather than their virtual
+    // `hit`, so callers which know the object types can have the whole
+    // traversal inlined. `Record` needs the `t` of `hit_record`.
+    template <class Record, class Leaf_Hit>
+    bool hit_with(
+        const Ray& r, double t_min, double t_max, Record& rec,
+        const Leaf_Hit& leaf_hit) const {
+      return root >= 0 && hit_node(root, r, t_min, t_max, rec, leaf_hit);
+    }
+
+    virtual bool occluded(
+        const Ray& r, double t_min, double t_max) const override {
+      return root >= 0 && occluded_node(root, r, t_min, t_max);
+    }
+
+    virtual bool bounding_box(AABB& output_box) const override {
+      if (root < 0) {
+        return false;
+      }
+      output_box = nodes[root].box;
+      return true;
+    }
+
+  // FIELDS //
+  public:
+    // rebuild once the overlap has grown by this much since the last build
+    double rebuild_overlap = 0.015;
+
+  private:
+    struct node {
+      AABB box;
+      int parent;
+      // children of an internal node
+      int left, right;
+      // handle of the object in a leaf, -1 for internal nodes
+      int object;
+      // of an internal node, the share of its box its children overlap in
+      double overlap = 0;
+    };
+
+    // TREE TRAVERSAL //
+
+    template <class Record, class Leaf_Hit>
+    bool hit_node(
+        int n, const Ray& r, double t_min, double t_max, Record& rec,
+        const Leaf_Hit& leaf_hit) const {
+      const auto& nd = nodes[n];
+      if (!nd.box.hit(r, t_min, t_max)) {
+        return false;
+      }
+      if (nd.object >= 0) {
+        return leaf_hit(nd.object, r, t_min, t_max, rec);
+      }
+
+      // only look for hits closer than what the left subtree found
+      bool hit_left = hit_node(nd.left, r, t_min, t_max, rec, leaf_hit);
+      bool hit_right = hit_node(
+          nd.right, r, t_min, hit_left ? rec.t : t_max, rec, leaf_hit);
+      return hit_left || hit_right;
+    }
+
+    bool occluded_node(int n, const Ray& r, double t_min, double t_max) const {
+      const auto& nd = nodes[n];
+      if (!nd.box.hit(r, t_min, t_max)) {
+        return false;
+      }
+      if (nd.object >= 0) {
+        return objects[nd.object]->occluded(r, t_min, t_max);
+      }
+      return occluded_node(nd.left, r, t_min, t_max)
+          || occluded_node(nd.right, r, t_min, t_max);
+    }
+
+    // NODE MGMT //
+
+    int alloc_node() {
+      if (!free_nodes.empty()) {
+        int n = free_nodes.back();
+        free_nodes.pop_back();
+        return n;
+      }
+      nodes.push_back(node());
+      return static_cast<int>(nodes.size()) - 1;
+    }
+
+    void free_node(int n) {
+      free_nodes.push_back(n);
+    }
+
+    int new_leaf(int handle) {
+      int leaf = alloc_node();
+      nodes[leaf] = { AABB(), -1, -1, -1, handle };
+      objects[handle]->bounding_box(nodes[leaf].box);
+      leaf_of[handle] = leaf;
+      return leaf;
+    }
+
+    // set the box of internal node `n`, keeping track of the total area, and
+    // of the overlap of its (current) children
+    void set_internal_box(int n, const AABB& box) {
+      internal_area += box.surface_area() - nodes[n].box.surface_area();
+      nodes[n].box = box;
+      set_overlap(n);
+    }
+
+    void set_overlap(int n) {
+      const auto& l = nodes[nodes[n].left].box;
+      const auto& r = nodes[nodes[n].right].box;
+      auto area = nodes[n].box.surface_area();
+
+      double shared = 0;
+      Point3 lo(fmax(l.min().x(), r.min().x()),
+                fmax(l.min().y(), r.min().y()),
+                fmax(l.min().z(), r.min().z()));
+      Point3 hi(fmin(l.max().x(), r.max().x()),
+                fmin(l.max().y(), r.max().y()),
+                fmin(l.max().z(), r.max().z()));
+      if (area > 0 && lo.x() <= hi.x() && lo.y() <= hi.y() && lo.z() <= hi.z()) {
+        shared = AABB(lo, hi).surface_area() / area;
+      }
+
+      internal_overlap += shared - nodes[n].overlap;
+      nodes[n].overlap = shared;
+    }
+
+    // Build a subtree over handles [lo, hi[ , by splitting them at the median
+    // along the longest axis of their centroids. Returns the subtree's root.
+    int build(std::vector<int>& handles, size_t lo, size_t hi, int parent) {
+      if (hi - lo == 1) {
+        int leaf = new_leaf(handles[lo]);
+        nodes[leaf].parent = parent;
+        return leaf;
+      }
+
+      // bounds of the centroids, to pick the split axis
+      AABB centroids;
+      for (size_t k = lo; k < hi; ++k) {
+        auto c = centroid(handles[k]);
+        centroids = k == lo ? AABB(c, c) : surrounding_box(centroids, AABB(c, c));
+      }
+      int axis = centroids.longest_axis();
+
+      size_t mid = lo + (hi - lo) / 2;
+      std::nth_element(
+          handles.begin() + lo, handles.begin() + mid, handles.begin() + hi,
+          [this, axis](int a, int b) { return centroid(a)[axis] < centroid(b)[axis]; });
+
+      int n = alloc_node();
+      nodes[n] = { AABB(), parent, -1, -1, -1 };
+      int left = build(handles, lo, mid, n);
+      int right = build(handles, mid, hi, n);
+      nodes[n].left = left;
+      nodes[n].right = right;
+      set_internal_box(n, surrounding_box(nodes[left].box, nodes[right].box));
+      return n;
+    }
+
+    Point3 centroid(int handle) const {
+      AABB box;
+      objects[handle]->bounding_box(box);
+      return 0.5 * (box.min() + box.max());
+    }
+
+    // Recompute the boxes from internal node `n` up to the root, stopping
+    // early once a box comes out unchanged (its children may still overlap
+    // differently, though)
+    void refit(int n) {
+      while (n >= 0) {
+        auto box = surrounding_box(nodes[nodes[n].left].box, nodes[nodes[n].right].box);
+        if (box == nodes[n].box) {
+          set_overlap(n);
+          return;
+        }
+        set_internal_box(n, box);
+        n = nodes[n].parent;
+      }
+    }
+
+    // Hook `leaf` into the tree, next to the node whose box grows the least
+    // by including it
+    void insert_leaf(int leaf) {
+      if (root < 0) {
+        root = leaf;
+        nodes[leaf].parent = -1;
+        return;
+      }
+
+      // (a copy, as allocating a node below may move `nodes`)
+      auto box = nodes[leaf].box;
+      int sibling = root;
+      while (nodes[sibling].object < 0) {
+        auto& nd = nodes[sibling];
+        auto grow_left = surrounding_box(nodes[nd.left].box, box).surface_area()
+                       - nodes[nd.left].box.surface_area();
+        auto grow_right = surrounding_box(nodes[nd.right].box, box).surface_area()
+                        - nodes[nd.right].box.surface_area();
+        sibling = grow_left <= grow_right ? nd.left : nd.right;
+      }
+
+      // a new internal node takes the sibling's place, with the sibling and
+      // the leaf as its children
+      int parent = nodes[sibling].parent;
+      int n = alloc_node();
+      nodes[n] = { AABB(), parent, sibling, leaf, -1 };
+      set_internal_box(n, surrounding_box(nodes[sibling].box, box));
+      nodes[sibling].parent = n;
+      nodes[leaf].parent = n;
+
+      if (parent < 0) {
+        root = n;
+      }
+      else {
+        (nodes[parent].left == sibling ? nodes[parent].left : nodes[parent].right) = n;
+        refit(parent);
+      }
+    }
+
+    // Unhook `leaf` from the tree; its parent is replaced by its sibling
+    void remove_leaf(int leaf) {
+      if (leaf == root) {
+        root = -1;
+        return;
+      }
+
+      int parent = nodes[leaf].parent;
+      int grandparent = nodes[parent].parent;
+      int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+      internal_area -= nodes[parent].box.surface_area();
+      internal_overlap -= nodes[parent].overlap;
+      free_node(parent);
+
+      nodes[sibling].parent = grandparent;
+      if (grandparent < 0) {
+        root = sibling;
+      }
+      else {
+        auto& gp = nodes[grandparent];
+        (gp.left == parent ? gp.left : gp.right) = sibling;
+        refit(grandparent);
+      }
+    }
+
+    // rebuild the tree if the edits have made it too slow to traverse
+    void maybe_rebuild() {
+      if (overlap() > built_overlap + rebuild_overlap) {
+        rebuild();
+      }
+    }
+
+  private:
+    std::vector<node> nodes;
+    std::vector<int> free_nodes;
+    int root = -1;
+
+    // objects by handle (nullptr for removed ones), and their leaves
+    std::vector<shared_ptr<Hittable>> objects;
+    std::vector<int> leaf_of;
+    std::vector<int> free_handles;
+
+    // summed surface area of all internal nodes, for the SAH cost
+    double internal_area = 0;
+    // summed overlap of all internal nodes, and its average after the last
+    // build
+    double internal_overlap = 0;
+    double built_overlap = 0;
+    int rebuilds = 0;
+};
+
+#endif
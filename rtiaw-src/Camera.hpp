@@ -54,6 +54,17 @@ class Camera {
       );
     }
 
+    // ray through (s, t) from the centre of the lens, as if the aperture
+    // were 0 (no depth of field, and no random numbers drawn)
+    Ray get_pinhole_ray(double s, double t) const {
+      return Ray(origin, lower_left_corner + s * horizontal + t * vertical - origin);
+    }
+
+    // does the camera have depth of field?
+    bool has_lens() const {
+      return lens_radius > 0;
+    }
+
   private:
     // FIELDS //
 
@@ -13,7 +13,8 @@ void write_colour(std::ostream &out, Colour pixel_colour, int samples_per_pixel)
   auto b = pixel_colour.z();
 
   // Divide the colour by the #samples and gamma-correct for gamma=2.0
-  auto scale = 1.0 / samples_per_pixel;
+  // (a pixel without any samples is left black)
+  auto scale = samples_per_pixel > 0 ? 1.0 / samples_per_pixel : 0.0;
   r = sqrt(scale * r);
   g = sqrt(scale * g);
   b = sqrt(scale * b);
@@ -25,4 +26,18 @@ void write_colour(std::ostream &out, Colour pixel_colour, int samples_per_pixel)
       << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
 }
 
+// Gamma-correct the averaged colour and translate it to [0, 255] bytes, for
+// binary (P6) output
+inline void colour_to_bytes(
+    Colour pixel_colour, int samples_per_pixel, unsigned char rgb[3]
+) {
+  // no samples yet means nothing to show
+  auto scale = samples_per_pixel > 0 ? 1.0 / samples_per_pixel : 0.0;
+
+  for (int k = 0; k < 3; ++k) {
+    auto c = sqrt(scale * pixel_colour[k]);
+    rgb[k] = static_cast<unsigned char>(256 * clamp(c, 0.0, 0.999));
+  }
+}
+
 #endif
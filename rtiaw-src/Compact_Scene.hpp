@@ -0,0 +1,160 @@
+#ifndef COMPACT_SCENE_H
+#define COMPACT_SCENE_H
+
+#include "RTWeekend.hpp"
+
+#include "Arena.hpp"
+#include "BVH.hpp"
+#include "Hittable_List.hpp"
+#include "Sphere.hpp"
+#include "Material.hpp"
+
+#include <map>
+#include <vector>
+
+// A read-only copy of a scene, laid out for rendering.
+//
+// All spheres and materials are copied into a single arena allocation: first
+// the materials, then the spheres, each run contiguous and in the order a
+// depth-first walk of the BVH reaches them, so that neighbouring leaves are
+// also neighbours in memory. The copies refer to each other through
+// non-owning `arena_ptr`s, so there are no control blocks in between the
+// objects, and hitting them costs no reference counting.
+//
+// Objects other than spheres, materials of unknown types, and textures other
+// than solid colours are shared with the original scene rather than copied.
+class Compact_Scene : public Hittable {
+  public:
+    // CONSTRUCTORS //
+    Compact_Scene(const Hittable_List& list) {
+      // traversal order of the original objects
+      auto order = BVH(list).leaf_order();
+
+      // the spheres, and their distinct materials in order of first use
+      std::vector<shared_ptr<Material>> materials;
+      std::map<const Material*, shared_ptr<Material>> copies;
+      size_t bytes = 0;
+
+      for (int h : order) {
+        auto sphere = dynamic_cast<const Sphere*>(list.objects[h].get());
+        if (!sphere) {
+          continue;
+        }
+        bytes += Arena::footprint<Sphere>();
+
+        if (copies.emplace(sphere->mat_ptr.get(), nullptr).second) {
+          materials.push_back(sphere->mat_ptr);
+          bytes += material_footprint(sphere->mat_ptr.get());
+        }
+      }
+
+      // all of it in one go
+      arena.reserve(bytes);
+
+      for (const auto& m : materials) {
+        copies[m.get()] = copy_material(m);
+      }
+      for (int h : order) {
+        auto sphere = dynamic_cast<const Sphere*>(list.objects[h].get());
+        if (!sphere) {
+          compact.add(list.objects[h]);
+          continue;
+        }
+        auto copy = arena.create<Sphere>(
+            sphere->center, sphere->radius, copies[sphere->mat_ptr.get()]);
+        compact.add(arena_ptr<Hittable>(copy));
+      }
+
+      bvh = BVH(compact);
+    }
+
+    Compact_Scene(const Compact_Scene&) = delete;
+    Compact_Scene& operator=(const Compact_Scene&) = delete;
+
+    // ACCESSORS //
+
+    const Arena& storage() const {
+      return arena;
+    }
+
+    size_t size() const {
+      return compact.objects.size();
+    }
+
+    // the BVH, whose handles index `objects()`
+    const BVH& accel() const {
+      return bvh;
+    }
+
+    const std::vector<shared_ptr<Hittable>>& objects() const {
+      return compact.objects;
+    }
+
+    // METHODS //
+    virtual bool hit(
+        const Ray& r, double t_min, double t_max, hit_record& rec) const override {
+      return bvh.hit(r, t_min, t_max, rec);
+    }
+
+    virtual bool occluded(
+        const Ray& r, double t_min, double t_max) const override {
+      return bvh.occluded(r, t_min, t_max);
+    }
+
+    virtual bool bounding_box(AABB& output_box) const override {
+      return bvh.bounding_box(output_box);
+    }
+
+  private:
+    // arena space needed for a copy of `m`
+    static size_t material_footprint(const Material* m) {
+      if (auto l = dynamic_cast<const Lambertian*>(m)) {
+        return Arena::footprint<Lambertian>() + texture_footprint(l->albedo.get());
+      }
+      if (auto mt = dynamic_cast<const Metal*>(m)) {
+        return Arena::footprint<Metal>() + texture_footprint(mt->albedo.get());
+      }
+      if (dynamic_cast<const Dielectric*>(m)) return Arena::footprint<Dielectric>();
+      return 0;
+    }
+
+    static size_t texture_footprint(const Texture* t) {
+      return dynamic_cast<const Solid_Colour*>(t) ? Arena::footprint<Solid_Colour>() : 0;
+    }
+
+    // copy `m` into the arena if we know how to, otherwise share it
+    shared_ptr<Material> copy_material(const shared_ptr<Material>& m) {
+      if (auto l = dynamic_cast<const Lambertian*>(m.get())) {
+        auto copy = arena.create<Lambertian>(*l);
+        copy->albedo = copy_texture(l->albedo);
+        return arena_ptr<Material>(copy);
+      }
+      if (auto mt = dynamic_cast<const Metal*>(m.get())) {
+        auto copy = arena.create<Metal>(*mt);
+        copy->albedo = copy_texture(mt->albedo);
+        return arena_ptr<Material>(copy);
+      }
+      if (auto d = dynamic_cast<const Dielectric*>(m.get())) {
+        return arena_ptr<Material>(arena.create<Dielectric>(*d));
+      }
+      return m;
+    }
+
+    // the same for textures
+    shared_ptr<Texture> copy_texture(const shared_ptr<Texture>& t) {
+      if (auto sc = dynamic_cast<const Solid_Colour*>(t.get())) {
+        return arena_ptr<Texture>(arena.create<Solid_Colour>(*sc));
+      }
+      return t;
+    }
+
+  // FIELDS //
+  private:
+    // declared first, so that it goes last
+    Arena arena;
+    // the copies, in traversal order
+    Hittable_List compact;
+    BVH bvh;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "Colour.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Accumulation buffer for a rendered image: the sum of all sample colours
+// and the number of samples taken, per pixel.
+//
+// The buffer may only cover a crop window (`x0`, `y0`, `width`, `height`) of
+// the full `full_width` x `full_height` image. All pixel coordinates taken by
+// the methods are full-image coordinates, with (0, 0) being the bottom-left
+// corner, matching the camera's (u, v).
+class Framebuffer {
+  public:
+    // CONSTRUCTORS //
+    Framebuffer()
+      : full_width(0), full_height(0), x0(0), y0(0), width(0), height(0)
+    {}
+
+    // buffer for the whole `w` x `h` image
+    Framebuffer(int w, int h) : Framebuffer(w, h, 0, 0, w, h) {}
+
+    // buffer for the `cw` x `ch` window at (`cx`, `cy`) of a `w` x `h` image
+    Framebuffer(int w, int h, int cx, int cy, int cw, int ch)
+      : full_width(w), full_height(h), x0(cx), y0(cy), width(cw), height(ch),
+        sums(static_cast<size_t>(cw) * ch), samples(static_cast<size_t>(cw) * ch, 0)
+    {}
+
+    // ACCESSORS //
+    int x1() const {
+      return x0 + width;
+    }
+
+    int y1() const {
+      return y0 + height;
+    }
+
+    bool contains(int i, int j) const {
+      return x0 <= i && i < x1() && y0 <= j && j < y1();
+    }
+
+    size_t index(int i, int j) const {
+      return static_cast<size_t>(j - y0) * width + (i - x0);
+    }
+
+    // METHODS //
+
+    // add `n` samples, whose colours sum to `colour_sum`, to pixel (i, j)
+    void add(int i, int j, const Colour& colour_sum, int n) {
+      auto k = index(i, j);
+      sums[k] += colour_sum;
+      samples[k] += n;
+    }
+
+    // Paste the pixels of `crop` into this buffer, replacing what was there
+    // (or adding to it, if `accumulate`). Fails if `crop` is from a
+    // differently sized image, or doesn't lie within this buffer.
+    bool paste(const Framebuffer& crop, bool accumulate) {
+      if (crop.full_width != full_width || crop.full_height != full_height
+          || crop.x0 < x0 || crop.y0 < y0
+          || crop.x1() > x1() || crop.y1() > y1()) {
+        return false;
+      }
+
+      for (int j = crop.y0; j < crop.y1(); ++j) {
+        for (int i = crop.x0; i < crop.x1(); ++i) {
+          auto k = index(i, j);
+          auto ck = crop.index(i, j);
+          if (accumulate) {
+            sums[k] += crop.sums[ck];
+            samples[k] += crop.samples[ck];
+          }
+          else {
+            sums[k] = crop.sums[ck];
+            samples[k] = crop.samples[ck];
+          }
+        }
+      }
+      return true;
+    }
+
+    // Write the buffer as a plain (P3) PPM, top scanline first
+    void write_ppm(std::ostream& out) const {
+      out << "P3\n" << width << ' ' << height << "\n255\n";
+
+      for (int j = y1() - 1; j >= y0; --j) {
+        for (int i = x0; i < x1(); ++i) {
+          auto k = index(i, j);
+          write_colour(out, sums[k], samples[k]);
+        }
+      }
+    }
+
+    // ACCUMULATION FILES //
+    //
+    // A text header line, followed by the raw per-pixel sums (3 doubles each)
+    // and sample counts (int32 each), in the machine's byte order:
+    //
+    //   RTACC1 <full_width> <full_height> <x0> <y0> <width> <height>\n
+
+    bool save(const std::string& path) const {
+      std::ofstream out(path, std::ios::binary);
+      out << "RTACC1 " << full_width << ' ' << full_height << ' '
+          << x0 << ' ' << y0 << ' ' << width << ' ' << height << '\n';
+
+      for (const auto& c : sums) {
+        out.write(reinterpret_cast<const char*>(c.e), sizeof(c.e));
+      }
+      for (auto n : samples) {
+        int32_t n32 = n;
+        out.write(reinterpret_cast<const char*>(&n32), sizeof(n32));
+      }
+      return static_cast<bool>(out);
+    }
+
+    bool load(const std::string& path) {
+      std::ifstream in(path, std::ios::binary);
+      std::string magic;
+      int fw, fh, cx, cy, cw, ch;
+      in >> magic >> fw >> fh >> cx >> cy >> cw >> ch;
+      if (!in || magic != "RTACC1" || in.get() != '\n'
+          || cw < 0 || ch < 0 || cx < 0 || cy < 0
+          || cx > fw || cy > fh || cw > fw - cx || ch > fh - cy) {
+        return false;
+      }
+
+      *this = Framebuffer(fw, fh, cx, cy, cw, ch);
+      for (auto& c : sums) {
+        in.read(reinterpret_cast<char*>(c.e), sizeof(c.e));
+      }
+      for (auto& n : samples) {
+        int32_t n32;
+        in.read(reinterpret_cast<char*>(&n32), sizeof(n32));
+        n = n32;
+      }
+      return static_cast<bool>(in);
+    }
+
+  // FIELDS //
+  public:
+    // size of the full image
+    int full_width;
+    int full_height;
+    // the window covered by this buffer
+    int x0, y0;
+    int width;
+    int height;
+    // per-pixel sum of sample colours
+    std::vector<Colour> sums;
+    // per-pixel number of samples
+    std::vector<int> samples;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "Ray.hpp"
 #include "RTWeekend.hpp"
+#include "AABB.hpp"
 
 class Material;
 
@@ -15,6 +16,9 @@ struct hit_record {
   shared_ptr<Material> mat_ptr;
   // `t` at which the hit occurred
   double t;
+  // surface coordinates of the hit, for textures
+  double u;
+  double v;
   // did the ray hit inside or outside?
   bool front_face;
 
@@ -29,6 +33,15 @@ struct hit_record {
 class Hittable {
   public:
     virtual bool hit(const Ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+
+    // any-hit query: is there *something* in [t_min, t_max] along the ray?
+    // (unlike `hit`, this may stop at the first intersection found and never
+    //  fills in a `hit_record`, which makes it much cheaper for visibility)
+    virtual bool occluded(const Ray& r, double t_min, double t_max) const = 0;
+
+    // compute a box containing the whole object; false if it has no box
+    // (e.g. it is infinite, or an empty list)
+    virtual bool bounding_box(AABB& output_box) const = 0;
 };
 
 #endif
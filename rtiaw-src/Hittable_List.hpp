@@ -32,6 +32,11 @@ class Hittable_List : public Hittable {
     virtual bool hit(
         const Ray& r, double t_min, double t_max, hit_record& rec) const override;
 
+    virtual bool occluded(
+        const Ray& r, double t_min, double t_max) const override;
+
+    virtual bool bounding_box(AABB& output_box) const override;
+
   // FIELDS //
   public:
     std::vector<shared_ptr<Hittable>> objects;
@@ -54,5 +59,38 @@ bool Hittable_List::hit(const Ray& r, double t_min, double t_max, hit_record& re
   return hit_anything;
 }
 
+// determine whether any of the `Hittable`s in the list block the ray
+bool Hittable_List::occluded(const Ray& r, double t_min, double t_max) const {
+  for (const auto& object : objects) {
+    // the first blocker is enough, no need to find the closest one
+    if (object->occluded(r, t_min, t_max)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// compute the box surrounding all of the `Hittable`s in the list
+bool Hittable_List::bounding_box(AABB& output_box) const {
+  if (objects.empty()) {
+    return false;
+  }
+
+  AABB temp_box;
+  bool first_box = true;
+
+  for (const auto& object : objects) {
+    // one unbounded object makes the whole list unbounded
+    if (!object->bounding_box(temp_box)) {
+      return false;
+    }
+    output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
+    first_box = false;
+  }
+
+  return true;
+}
+
 #endif
 
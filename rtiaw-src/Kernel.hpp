@@ -0,0 +1,295 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "RTWeekend.hpp"
+
+#include "Camera.hpp"
+#include "Compact_Scene.hpp"
+#include "Framebuffer.hpp"
+#include "Hittable_List.hpp"
+#include "Material.hpp"
+#include "Render.hpp"
+#include "Sphere.hpp"
+
+#include <string>
+#include <vector>
+
+// Render kernels specialised at compile time.
+//
+// `Generic_Sampler` decides everything at run time: virtual `hit` and
+// `scatter`, a run-time maximum depth, and the camera's aperture. A `Kernel`
+// fixes all of these through its template parameters instead:
+//
+//   - the camera policy: `Pinhole` or `Thin_Lens`
+//   - the primitive set: `Spheres_Only` (a closed set of sphere and material
+//     types, dispatched without virtual calls) or `Any_Hittable`
+//   - the maximum depth, which unrolls the recursion of the path
+//
+// so the compiler can inline the whole path. `with_kernel` picks, at run
+// time, the best of the instantiations below for a scene and camera.
+//
+// With the same camera, a kernel takes exactly the same samples as
+// `Generic_Sampler`. (`Pinhole` draws no random numbers for the lens,
+// though, so its images differ from those of a zero-aperture `Thin_Lens`.)
+
+// SCENE //
+
+// the closed set of materials known to `Spheres_Only`
+enum class material_kind : unsigned char { lambertian, metal, dielectric };
+
+// A `Compact_Scene`, plus what `Spheres_Only` kernels need to know about it
+class Kernel_Scene {
+  public:
+    // CONSTRUCTORS //
+    Kernel_Scene(const Hittable_List& list) : compact(list) {
+      spheres_only = true;
+      for (const auto& object : compact.objects()) {
+        auto sphere = dynamic_cast<const Sphere*>(object.get());
+        material_kind kind;
+        if (!sphere || !kind_of(sphere->mat_ptr.get(), kind)) {
+          // not a closed set, so no `Spheres_Only` kernels
+          spheres_only = false;
+          spheres.clear();
+          kinds.clear();
+          return;
+        }
+        spheres.push_back(sphere);
+        kinds.push_back(kind);
+      }
+    }
+
+    // ACCESSORS //
+    const Hittable& world() const {
+      return compact;
+    }
+
+  private:
+    static bool kind_of(const Material* m, material_kind& kind) {
+      if (dynamic_cast<const Lambertian*>(m))      kind = material_kind::lambertian;
+      else if (dynamic_cast<const Metal*>(m))      kind = material_kind::metal;
+      else if (dynamic_cast<const Dielectric*>(m)) kind = material_kind::dielectric;
+      else return false;
+      return true;
+    }
+
+  // FIELDS //
+  public:
+    Compact_Scene compact;
+    // can `Spheres_Only` kernels render this scene?
+    bool spheres_only;
+    // by BVH handle: the sphere, and the kind of its material
+    std::vector<const Sphere*> spheres;
+    std::vector<material_kind> kinds;
+};
+
+// CAMERA POLICIES //
+
+struct Pinhole {
+  static const char* name() { return "pinhole"; }
+
+  static Ray get_ray(const Camera& cam, double s, double t) {
+    return cam.get_pinhole_ray(s, t);
+  }
+};
+
+struct Thin_Lens {
+  static const char* name() { return "thin-lens"; }
+
+  static Ray get_ray(const Camera& cam, double s, double t) {
+    return cam.get_ray(s, t);
+  }
+};
+
+// PRIMITIVE SETS //
+
+struct Spheres_Only {
+  static const char* name() { return "spheres"; }
+
+  // a `hit_record`, plus which sphere was hit
+  struct record : hit_record {
+    int object;
+  };
+
+  static bool hit(
+      const Kernel_Scene& scene, const Ray& r, double t_min, double t_max,
+      record& rec
+  ) {
+    // only roots are compared during the traversal; the record is filled in
+    // once, for the closest hit
+    struct nearest {
+      double t;
+      int object;
+    } near;
+
+    bool hit = scene.compact.accel().hit_with(r, t_min, t_max, near,
+        [&scene](int h, const Ray& r, double t_min, double t_max, nearest& near) {
+          // a qualified call is a direct call, which can be inlined
+          if (!scene.spheres[h]->Sphere::nearest_root(r, t_min, t_max, near.t)) {
+            return false;
+          }
+          near.object = h;
+          return true;
+        });
+    if (!hit) {
+      return false;
+    }
+
+    scene.spheres[near.object]->fill_record(r, near.t, rec);
+    rec.object = near.object;
+    return true;
+  }
+
+  static bool scatter(
+      const Kernel_Scene& scene, const Ray& r_in, const record& rec,
+      Colour& attenuation, Ray& scattered
+  ) {
+    auto m = rec.mat_ptr.get();
+    switch (scene.kinds[rec.object]) {
+      case material_kind::lambertian:
+        return static_cast<const Lambertian*>(m)->Lambertian::scatter(
+            r_in, rec, attenuation, scattered);
+      case material_kind::metal:
+        return static_cast<const Metal*>(m)->Metal::scatter(
+            r_in, rec, attenuation, scattered);
+      case material_kind::dielectric:
+        return static_cast<const Dielectric*>(m)->Dielectric::scatter(
+            r_in, rec, attenuation, scattered);
+    }
+    return false;
+  }
+};
+
+struct Any_Hittable {
+  static const char* name() { return "any"; }
+
+  using record = hit_record;
+
+  static bool hit(
+      const Kernel_Scene& scene, const Ray& r, double t_min, double t_max,
+      record& rec
+  ) {
+    return scene.world().hit(r, t_min, t_max, rec);
+  }
+
+  static bool scatter(
+      const Kernel_Scene&, const Ray& r_in, const record& rec,
+      Colour& attenuation, Ray& scattered
+  ) {
+    return rec.mat_ptr->scatter(r_in, rec, attenuation, scattered);
+  }
+};
+
+// KERNEL //
+
+// A sampler (see `Generic_Sampler`) with everything fixed at compile time
+template <class Camera_Policy, class Prims, int Max_Depth>
+struct Kernel {
+  const Kernel_Scene& scene;
+  const Camera& cam;
+
+  static std::string name() {
+    return std::string(Camera_Policy::name()) + '/' + Prims::name()
+      + "/depth-" + std::to_string(Max_Depth);
+  }
+
+  Colour operator()(const Framebuffer& fb, int i, int j, int s) const {
+    Scoped_Seed seed(pixel_seed(i, j, s));
+
+    // horizontal and vertical components of ray on screen
+    auto u = (i + random_double()) / (fb.full_width - 1);
+    auto v = (j + random_double()) / (fb.full_height - 1);
+
+    Ray r = Camera_Policy::get_ray(cam, u, v);
+
+    return ray_colour<Max_Depth>(r);
+  }
+
+  // `ray_colour`, with the depth unrolled
+  template <int Depth>
+  Colour ray_colour(const Ray& r) const {
+    // if we hit the depth limit, the ray was absorbed
+    if constexpr (Depth <= 0) {
+      return Colour(0, 0, 0);
+    }
+    else {
+      typename Prims::record rec;
+
+      // checking for hits at 0.001 to account for floating-point approximations
+      if (Prims::hit(scene, r, 0.001, infinity, rec)) {
+        Ray scattered;
+        Colour attenuation;
+        if (Prims::scatter(scene, r, rec, attenuation, scattered)) {
+          return attenuation * ray_colour<Depth - 1>(scattered);
+        }
+        return Colour(0, 0, 0);
+      }
+
+      Vec3 unit_direction = unit_vector(r.direction());
+      auto t = 0.5 * (unit_direction.y() + 1.0);
+      return (1.0 - t) * Colour(1.0, 1.0, 1.0) + t * Colour(0.5, 0.7, 1.0);
+    }
+  }
+};
+
+// DISPATCH //
+
+// call `fn(sampler)` with the kernel for `Camera_Policy`, `Prims`, and
+// `max_depth`, if one was instantiated; false otherwise
+template <class Camera_Policy, class Prims, class Fn>
+bool with_depth(
+    const Kernel_Scene& scene, const Camera& cam, int max_depth,
+    const Fn& fn, std::string& name
+) {
+  switch (max_depth) {
+    case 10: {
+      Kernel<Camera_Policy, Prims, 10> k{ scene, cam };
+      name = k.name();
+      fn(k);
+      return true;
+    }
+    case 50: {
+      Kernel<Camera_Policy, Prims, 50> k{ scene, cam };
+      name = k.name();
+      fn(k);
+      return true;
+    }
+  }
+  return false;
+}
+
+template <class Camera_Policy, class Fn>
+bool with_prims(
+    const Kernel_Scene& scene, const Camera& cam, int max_depth,
+    const Fn& fn, std::string& name
+) {
+  if (scene.spheres_only) {
+    return with_depth<Camera_Policy, Spheres_Only>(scene, cam, max_depth, fn, name);
+  }
+  return with_depth<Camera_Policy, Any_Hittable>(scene, cam, max_depth, fn, name);
+}
+
+// Call `fn(sampler)` with the most specialised sampler for rendering `scene`
+// through `cam`, falling back to `Generic_Sampler` (or always using it, if
+// `generic`). `fn` is a generic lambda, instantiated for every kernel.
+// Returns the name of the sampler used.
+template <class Fn>
+std::string with_kernel(
+    const Kernel_Scene& scene, const Camera& cam, int max_depth, bool generic,
+    const Fn& fn
+) {
+  std::string name;
+  if (!generic) {
+    bool found = cam.has_lens()
+      ? with_prims<Thin_Lens>(scene, cam, max_depth, fn, name)
+      : with_prims<Pinhole>(scene, cam, max_depth, fn, name);
+    if (found) {
+      return name;
+    }
+  }
+
+  Generic_Sampler sampler{ scene.world(), cam, max_depth };
+  fn(sampler);
+  return "generic";
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "RTWeekend.hpp"
 
+#include "Texture.hpp"
+
 struct hit_record;
 
 class Material {
@@ -15,7 +17,8 @@ class Material {
 // class representing Lambertian diffuse materials
 class Lambertian : public Material {
   public:
-    Lambertian(const Colour& a) : albedo(a) {}
+    Lambertian(const Colour& a) : albedo(make_shared<Solid_Colour>(a)) {}
+    Lambertian(shared_ptr<Texture> a) : albedo(a) {}
 
     virtual bool scatter(
         const Ray& r_in, const hit_record& rec, Colour& attenuation, Ray& scattered
@@ -32,18 +35,20 @@ class Lambertian : public Material {
 
         // always scatter, but attenuate by the reflection
         // (instead of probability p of scattering & attenuating by albedo/p )
-        attenuation = albedo;
+        attenuation = albedo->value(rec.u, rec.v, rec.p);
         return true;
     }
 
   public:
-    Colour albedo;
+    shared_ptr<Texture> albedo;
 };
 
 // class representing reflictive metal material
 class Metal : public Material {
   public:
-    Metal(const Colour& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+    Metal(const Colour& a, double f)
+      : albedo(make_shared<Solid_Colour>(a)), fuzz(f < 1 ? f : 1) {}
+    Metal(shared_ptr<Texture> a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
     virtual bool scatter(
         const Ray& r_in, const hit_record& rec, Colour& attenuation, Ray& scattered
@@ -52,13 +57,13 @@ class Metal : public Material {
         Vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
         // scatter the ray, factoring in fuzziness
         scattered = Ray(rec.p, reflected + fuzz * random_in_unit_sphere());
-        attenuation = albedo;
+        attenuation = albedo->value(rec.u, rec.v, rec.p);
         // scatter if the direction doesn't cancel the normal
         return dot(scattered.direction(), rec.normal) > 0;
     }
 
   public:
-    Colour albedo;
+    shared_ptr<Texture> albedo;
     double fuzz;
 };
 
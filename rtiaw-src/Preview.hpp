@@ -0,0 +1,308 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "Colour.hpp"
+#include "Framebuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cerrno>
+#include <climits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// progress of the render at the time a snapshot was taken
+struct preview_stats {
+  // scanlines (or passes) completed so far, out of `total`
+  int done;
+  int total;
+  // seconds since the render started
+  double elapsed;
+};
+
+// Progressive output of the framebuffer while a render is running.
+//
+// Snapshots are written as a stream of binary (P6) PPM frames to a file
+// descriptor, e.g. a named pipe (`mkfifo`) which a local viewer reads from.
+// Each frame carries its stats in a header comment:
+//
+//   P6
+//   # done=<n> total=<n> elapsed=<seconds>
+//   <width> <height>
+//   255
+//   <width * height * 3 bytes>
+//
+// The render thread never waits on the viewer: `offer` copies the
+// framebuffer into a back buffer (skipping the snapshot entirely if the
+// publisher is busy with it), and a separate publisher thread swaps it out,
+// downsamples, tonemaps, and writes it. Writes only go out once there's room
+// for them, so a viewer which stops reading can't hold up shutdown either: `finish` gives up on the
+// final frame after a timeout, and a frame still being written when the
+// preview goes is abandoned.
+class Preview {
+  public:
+    // CONSTRUCTORS //
+
+    // publish to `path` (created if it doesn't exist) every `interval`
+    // seconds, box-downsampling the image by `scale`
+    Preview(const std::string& path, double interval, int scale)
+      : fd(-1), owns_fd(true), path(path), interval(interval),
+        scale(scale < 1 ? 1 : scale)
+    {
+      start();
+    }
+
+    // publish to the already-open file descriptor `fd`
+    Preview(int fd, double interval, int scale)
+      : fd(fd), owns_fd(false), interval(interval),
+        scale(scale < 1 ? 1 : scale)
+    {
+      start();
+    }
+
+    ~Preview() {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+      }
+      cv.notify_one();
+      publisher.join();
+
+      if (owns_fd && fd >= 0) {
+        close(fd);
+      }
+    }
+
+    Preview(const Preview&) = delete;
+    Preview& operator=(const Preview&) = delete;
+
+    // METHODS //
+
+    // Offer the current framebuffer for publishing. Called from the render
+    // thread; cheap when no snapshot is due, and never blocks.
+    void offer(const Framebuffer& fb, int done, int total) {
+      auto now = std::chrono::steady_clock::now();
+      if (now < next_due || broken) {
+        return;
+      }
+
+      // the publisher is busy swapping buffers, try again next time
+      std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+      if (!lock.owns_lock()) {
+        return;
+      }
+
+      // copy-on-publish: the render thread keeps going with `fb`
+      back = fb;
+      back_stats = { done, total, seconds_since_start(now) };
+      fresh = true;
+      next_due = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval));
+
+      lock.unlock();
+      cv.notify_one();
+    }
+
+    // Publish the final image, waiting at most `timeout` seconds for it to
+    // be written out. Returns whether it was.
+    bool finish(const Framebuffer& fb, int done, int total, double timeout = 2.0) {
+      std::unique_lock<std::mutex> lock(mtx);
+      back = fb;
+      back_stats = { done, total, seconds_since_start(std::chrono::steady_clock::now()) };
+      fresh = true;
+      cv.notify_one();
+
+      // wait for the publisher to pick it up and write it, as long as there
+      // is someone to write it to
+      written.wait_for(lock, std::chrono::duration<double>(timeout), [this] {
+          return (!fresh && !writing) || broken || !connected;
+      });
+      return !fresh && !writing && !broken && connected;
+    }
+
+  private:
+    void start() {
+      // a viewer going away shouldn't kill the render
+      std::signal(SIGPIPE, SIG_IGN);
+
+      started = std::chrono::steady_clock::now();
+      next_due = started;
+      publisher = std::thread(&Preview::publish_loop, this);
+    }
+
+    double seconds_since_start(std::chrono::steady_clock::time_point now) const {
+      return std::chrono::duration<double>(now - started).count();
+    }
+
+    // publisher thread: wait for fresh snapshots and write them out
+    void publish_loop() {
+      // a named pipe can't be opened for writing until a reader shows up, so
+      // keep polling for one (without blocking shutdown) until it does
+      if (fd < 0 && !open_output()) {
+        return;
+      }
+      connected = true;
+
+      std::vector<unsigned char> frame;
+      while (true) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return fresh || stopping; });
+        if (!fresh) {
+          return;   // stopping, and nothing left to write
+        }
+
+        // double buffering: take the snapshot, and hand back our old buffer
+        std::swap(front, back);
+        auto stats = back_stats;
+        fresh = false;
+        writing = true;
+        lock.unlock();
+
+        encode(front, stats, frame);
+        bool ok = write_all(frame.data(), frame.size());
+
+        lock.lock();
+        writing = false;
+        if (!ok) {
+          broken = true;
+        }
+        written.notify_all();
+        if (!ok) {
+          return;
+        }
+      }
+    }
+
+    // open `path` for writing, waiting for a reader if it is a named pipe;
+    // false if it can't be opened, or we were stopped while waiting
+    bool open_output() {
+      while (true) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+        if (fd >= 0) {
+          return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx);
+        if (errno != ENXIO) {
+          broken = true;
+          written.notify_all();
+          return false;
+        }
+        // no reader on the pipe yet
+        if (cv.wait_for(lock, std::chrono::milliseconds(200),
+                        [this] { return stopping.load(); })) {
+          return false;
+        }
+      }
+    }
+
+    // downsample and tonemap `fb` into a P6 frame
+    void encode(
+        const Framebuffer& fb, const preview_stats& stats,
+        std::vector<unsigned char>& out
+    ) const {
+      int w = (fb.width + scale - 1) / scale;
+      int h = (fb.height + scale - 1) / scale;
+
+      std::string header = "P6\n# done=" + std::to_string(stats.done)
+        + " total=" + std::to_string(stats.total)
+        + " elapsed=" + std::to_string(stats.elapsed) + '\n'
+        + std::to_string(w) + ' ' + std::to_string(h) + "\n255\n";
+
+      out.assign(header.begin(), header.end());
+      out.reserve(header.size() + w * h * 3);
+
+      // top scanline first, like the final image
+      for (int y = h - 1; y >= 0; --y) {
+        for (int x = 0; x < w; ++x) {
+          // box filter: pool all samples of the covered pixels
+          Colour sum(0, 0, 0);
+          int n = 0;
+          for (int j = fb.y0 + y * scale; j < fb.y0 + (y + 1) * scale && j < fb.y1(); ++j) {
+            for (int i = fb.x0 + x * scale; i < fb.x0 + (x + 1) * scale && i < fb.x1(); ++i) {
+              auto k = fb.index(i, j);
+              sum += fb.sums[k];
+              n += fb.samples[k];
+            }
+          }
+
+          unsigned char rgb[3];
+          colour_to_bytes(sum, n, rgb);
+          out.insert(out.end(), rgb, rgb + 3);
+        }
+      }
+    }
+
+    // Write all of `buf`, retrying on partial writes and interrupts, and
+    // waiting for room in a full pipe; false on errors, or if we were stopped
+    // while waiting.
+    //
+    // A descriptor we were handed may share its flags with e.g. stdout, so it
+    // is left blocking: instead, we only write once `poll` says there's room,
+    // and no more than a pipe takes in one go.
+    bool write_all(const unsigned char* buf, size_t len) const {
+      while (len > 0) {
+        pollfd p = { fd, POLLOUT, 0 };
+        int ready = poll(&p, 1, 200);
+        if (ready < 0 && errno != EINTR) {
+          return false;
+        }
+        if (ready <= 0) {
+          // the viewer is behind; wait for it, but not past shutdown
+          if (stopping) {
+            return false;
+          }
+          continue;
+        }
+
+        auto n = write(fd, buf, std::min<size_t>(len, PIPE_BUF));
+        if (n < 0) {
+          if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+            continue;
+          }
+          return false;
+        }
+        buf += n;
+        len -= n;
+      }
+      return true;
+    }
+
+  // FIELDS //
+  private:
+    int fd;
+    bool owns_fd;
+    std::string path;
+    double interval;
+    int scale;
+
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point next_due;
+
+    std::mutex mtx;
+    std::condition_variable cv;       // fresh snapshot (or stop) for publisher
+    std::condition_variable written;  // publisher finished a frame
+    Framebuffer back;                 // latest snapshot, guarded by `mtx`
+    Framebuffer front;                // snapshot being written, publisher only
+    preview_stats back_stats = { 0, 0, 0.0 };
+    bool fresh = false;
+    bool writing = false;
+    // (also read by the publisher while writing, without locking)
+    std::atomic<bool> stopping{false};
+    // set by the publisher thread, read without locking by `offer`
+    std::atomic<bool> connected{false};
+    std::atomic<bool> broken{false};
+
+    std::thread publisher;
+};
+
+#endif
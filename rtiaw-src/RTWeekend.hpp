@@ -2,6 +2,7 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <cstdlib>
@@ -26,9 +27,66 @@ inline double degrees_to_radians(double degrees) {
   return degrees * pi / 180.0;
 }
 
+// Per-thread random number state. Outside of a `Scoped_Seed`,
+// `random_double` uses `rand()`, which is what the scenes were laid out with.
+struct random_state {
+  bool seeded = false;
+  uint64_t s = 0;
+};
+
+inline random_state& thread_random_state() {
+  thread_local random_state state;
+  return state;
+}
+
+// SplitMix64 step: advance `s` and return the next 64 random bits
+inline uint64_t splitmix64(uint64_t& s) {
+  uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// While in scope, gives the calling thread its own deterministic random
+// stream; the thread's previous state (e.g. back to `rand()`) comes back
+// when it goes
+class Scoped_Seed {
+  public:
+    explicit Scoped_Seed(uint64_t seed) : saved(thread_random_state()) {
+      auto& state = thread_random_state();
+      state.seeded = true;
+      state.s = seed;
+    }
+
+    ~Scoped_Seed() {
+      thread_random_state() = saved;
+    }
+
+    Scoped_Seed(const Scoped_Seed&) = delete;
+    Scoped_Seed& operator=(const Scoped_Seed&) = delete;
+
+  private:
+    random_state saved;
+};
+
+// Seed for sample `s` of pixel (i, j), so that every sample is the same no
+// matter how (or in which order) the image is split up and rendered
+inline uint64_t pixel_seed(int i, int j, int s) {
+  uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(j)) << 32)
+               | static_cast<uint32_t>(i);
+  uint64_t h = splitmix64(key);
+  h ^= static_cast<uint64_t>(static_cast<uint32_t>(s)) * 0xd1b54a32d192ed03ULL;
+  return splitmix64(h);
+}
+
 // Return a random real in [0, 1[ .
 inline double random_double() {
-  return rand() / (RAND_MAX + 1.0);
+  auto& state = thread_random_state();
+  if (!state.seeded) {
+    return rand() / (RAND_MAX + 1.0);
+  }
+  // top 53 bits, scaled to [0, 1[
+  return (splitmix64(state.s) >> 11) * (1.0 / 9007199254740992.0);
 }
 
 // Return a random real in [min, max[ .
@@ -0,0 +1,273 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "RTWeekend.hpp"
+
+#include "Hittable.hpp"
+#include "Camera.hpp"
+#include "Material.hpp"
+#include "Framebuffer.hpp"
+#include "Preview.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+// colour of the given ray
+Colour ray_colour(const Ray& r, const Hittable& world, int depth) {
+  hit_record rec;
+
+  // if we hit the depth limit, the ray was absorbed
+  if (depth <= 0) {
+    return Colour(0, 0, 0);
+  }
+
+  // checking for hits at 0.001 to account for floating-point approximations
+  if (world.hit(r, 0.001, infinity, rec)) {
+    Ray scattered;
+    Colour attenuation;
+    // check if the material scatters the ray
+    if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+      // if it scattered, handle that and attenuate the colour accordingly
+      return attenuation * ray_colour(scattered, world, depth - 1);
+    }
+    // absorb the ray if it didn't scatter
+    return Colour(0, 0, 0);
+  }
+
+  Vec3 unit_direction = unit_vector(r.direction());
+  auto t = 0.5 * (unit_direction.y() + 1.0);
+  return (1.0 - t) * Colour(1.0, 1.0, 1.0) + t * Colour(0.5, 0.7, 1.0);
+}
+
+// The generic sampler: anything `Hittable`, any camera, and a run-time
+// maximum depth. (Kernel.hpp has specialised ones.)
+//
+// A sampler maps sample `s` of pixel (i, j) to its colour; every sample has
+// its own random stream, so crops and progressive renders of the image come
+// out exactly as in the full render.
+struct Generic_Sampler {
+  const Hittable& world;
+  const Camera& cam;
+  int max_depth;
+
+  Colour operator()(const Framebuffer& fb, int i, int j, int s) const {
+    Scoped_Seed seed(pixel_seed(i, j, s));
+
+    // horizontal and vertical components of ray on screen
+    auto u = (i + random_double()) / (fb.full_width - 1);
+    auto v = (j + random_double()) / (fb.full_height - 1);
+
+    Ray r = cam.get_ray(u, v);
+
+    return ray_colour(r, world, max_depth);
+  }
+};
+
+// Render `samples_per_pixel` samples for every pixel of scanlines [j0, j1[
+// of `fb`, from the top. Samples are numbered from `first_sample`, so that
+// renders with different offsets take different samples and can be added up.
+template <class Sampler>
+void render_rows(
+    const Sampler& sample, Framebuffer& fb, int j0, int j1, int samples_per_pixel,
+    int first_sample = 0
+) {
+  for (int j = j1 - 1; j >= j0; --j) {
+    for (int i = fb.x0; i < fb.x1(); ++i) {
+      // initial colour is black
+      Colour pixel_colour(0, 0, 0);
+      // Anti-Aliasing
+      for (int s = first_sample; s < first_sample + samples_per_pixel; ++s) {
+        pixel_colour += sample(fb, i, j, s);
+      }
+      fb.add(i, j, pixel_colour, samples_per_pixel);
+    }
+  }
+}
+
+// Render `samples_per_pixel` samples for every pixel of `fb`, one scanline at
+// a time, from the top.
+template <class Sampler>
+void render_scanlines(
+    const Sampler& sample, Framebuffer& fb, int samples_per_pixel, Preview* preview,
+    int first_sample = 0
+) {
+  for (int j = fb.y1() - 1; j >= fb.y0; --j) {
+    // progress indicator
+    std::cerr << '\r' << "Scanlines remaining: " << j - fb.y0 << ' ' << std::flush;
+    render_rows(sample, fb, j, j + 1, samples_per_pixel, first_sample);
+
+    // hand the preview a snapshot, if one is due
+    if (preview) {
+      preview->offer(fb, fb.y1() - j, fb.height);
+    }
+  }
+}
+
+// the middle pixel of the `block` x `block` block of `fb` which pixel
+// (`i`, `j`) lies in, as (`ci`, `cj`)
+inline void block_centre(
+    const Framebuffer& fb, int block, int i, int j, int& ci, int& cj
+) {
+  ci = fb.x0 + std::min((i - fb.x0) / block * block + block / 2, fb.width - 1);
+  cj = fb.y0 + std::min((j - fb.y0) / block * block + block / 2, fb.height - 1);
+}
+
+// Take the first sample of the middle pixel of every `block` x `block` block
+// of `fb` which has none yet, until `deadline`, marking them in `sampled`
+// (by offset into `fb`). Returns the number of samples taken.
+template <class Sampler>
+long coarse_pass(
+    const Sampler& sample, Framebuffer& fb, int block,
+    std::chrono::steady_clock::time_point deadline, int first_sample,
+    std::vector<char>& sampled
+) {
+  long taken = 0;
+  for (int y = 0; y < fb.height; y += block) {
+    for (int x = 0; x < fb.width; x += block) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return taken;
+      }
+      int i, j;
+      block_centre(fb, block, fb.x0 + x, fb.y0 + y, i, j);
+      auto k = fb.index(i, j);
+      if (fb.samples[k] == 0) {
+        fb.add(i, j, sample(fb, i, j, first_sample), 1);
+        sampled[k] = 1;
+        ++taken;
+      }
+    }
+  }
+  return taken;
+}
+
+// the smallest square blocks of which `fb` has no more than `n_blocks`
+inline int coarse_block_size(const Framebuffer& fb, double n_blocks) {
+  int b = 2;
+  while (static_cast<double>((fb.width + b - 1) / b) * ((fb.height + b - 1) / b)
+         > n_blocks && b < fb.width + fb.height) {
+    ++b;
+  }
+  return b;
+}
+
+// Render progressive passes of one sample per pixel over all of `fb`, until
+// `max_samples` passes are done or `budget` seconds have passed.
+//
+// Each pass visits the pixels in a scattered (but fixed) order, so when the
+// deadline cuts the last pass short, its samples are still spread evenly over
+// the frame. Since every pixel is normalised by its own sample count, the
+// image is correct whenever the render stops.
+//
+// The throughput measured over the first samples plans the rest: if at that
+// rate the budget won't even last one pass, a coarse pass first takes a
+// sample in the middle of every block of pixels (sized to take about half of
+// the remaining budget), before the first pass carries on. Pixels the first
+// pass then doesn't get to are given their block's colour, as one sample, so
+// that none of the image is left black.
+//
+// Samples are numbered from `first_sample`, as in `render_rows`. Returns the
+// number of samples taken (not counting the ones filled in from blocks).
+template <class Sampler>
+long render_until(
+    const Sampler& sample, Framebuffer& fb,
+    double budget, int max_samples, Preview* preview, int first_sample = 0
+) {
+  using clock = std::chrono::steady_clock;
+
+  auto start = clock::now();
+  auto deadline = start + std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(budget));
+  auto seconds_since_start = [start] {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  };
+
+  // visit pixel (k * stride) mod n at step k; any stride coprime to n
+  // reaches every pixel exactly once per pass
+  long n = static_cast<long>(fb.width) * fb.height;
+  long stride = static_cast<long>(n * 0.6180339887) | 1;
+  while (std::gcd(stride, n) != 1) {
+    stride += 2;
+  }
+
+  // samples of the first pass after which to measure the throughput
+  const long calibration = 1024;
+
+  long taken = 0;
+  bool out_of_time = false;
+
+  // the coarse pass's blocks (0 if there is none), and the pixels it sampled,
+  // which the first pass skips
+  int block = 0;
+  std::vector<char> sampled;
+
+  // the pixel of `fb` at offset p, row by row
+  auto pixel_i = [&fb](long p) { return fb.x0 + static_cast<int>(p % fb.width); };
+  auto pixel_j = [&fb](long p) { return fb.y0 + static_cast<int>(p / fb.width); };
+
+  for (int s = 0; s < max_samples && !out_of_time; ++s) {
+    for (long k = 0, p = 0; k < n; ++k, p = (p + stride) % n) {
+      if (clock::now() >= deadline) {
+        out_of_time = true;
+        break;
+      }
+
+      if (s == 0 && k == calibration) {
+        double elapsed = seconds_since_start();
+        double affordable = taken / elapsed * (budget - elapsed);
+        if (affordable < n - k) {
+          block = coarse_block_size(fb, affordable / 2);
+          sampled.assign(n, 0);
+          taken += coarse_pass(sample, fb, block, deadline, first_sample, sampled);
+        }
+      }
+      if (s == 0 && block && sampled[p]) {
+        continue;
+      }
+
+      int i = pixel_i(p), j = pixel_j(p);
+      fb.add(i, j, sample(fb, i, j, first_sample + s), 1);
+      ++taken;
+
+      // hand the preview a snapshot every so often, if one is due
+      if (preview && k % 1024 == 0) {
+        preview->offer(fb, s, max_samples);
+      }
+    }
+
+    // progress indicator, with the throughput measured so far and what it
+    // means for the rest of the budget
+    double rate = taken / seconds_since_start();
+    double expected_spp = rate * budget / n;
+    std::cerr << '\r' << "Passes done: " << s + (out_of_time ? 0 : 1)
+              << ", " << rate << " samples/s, expecting ~"
+              << (expected_spp < max_samples ? expected_spp : max_samples)
+              << " spp " << std::flush;
+  }
+
+  // give the pixels which got no sample their block's colour
+  if (block) {
+    long filled = 0;
+    for (long p = 0; p < n; ++p) {
+      if (fb.samples[p] > 0) {
+        continue;
+      }
+      int i = pixel_i(p), j = pixel_j(p);
+      int ci, cj;
+      block_centre(fb, block, i, j, ci, cj);
+      auto c = fb.index(ci, cj);
+      if (fb.samples[c] > 0) {
+        fb.add(i, j, fb.sums[c] / fb.samples[c], 1);
+        ++filled;
+      }
+    }
+    std::cerr << '\n' << "Out of time for a full pass: filled in " << filled
+              << " pixels from " << block << 'x' << block << " blocks.";
+  }
+
+  return taken;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "RTWeekend.hpp"
+
+#include "BVH.hpp"
+#include "Hittable_List.hpp"
+#include "Sphere.hpp"
+#include "Material.hpp"
+
+#include <vector>
+
+// An editable scene of spheres, for look-dev between renders.
+//
+// Spheres are referred to by the id returned when they were added (or their
+// index in the list the scene was made from). Every edit updates the scene's
+// BVH in place, so its cost depends on the size of the edit rather than on
+// the size of the scene.
+//
+// Edits must not happen while the scene is being rendered.
+class Scene {
+  public:
+    // CONSTRUCTORS //
+    Scene() {}
+
+    // a scene of the spheres in `list`
+    Scene(const Hittable_List& list) {
+      for (const auto& object : list.objects) {
+        spheres.push_back(std::dynamic_pointer_cast<Sphere>(object));
+      }
+      bvh = BVH(list);
+    }
+
+    // EDITS //
+
+    // add a sphere, returning its id
+    int add_sphere(Point3 center, double radius, shared_ptr<Material> m) {
+      auto sphere = make_shared<Sphere>(center, radius, m);
+      int id = bvh.insert(sphere);
+      if (id == static_cast<int>(spheres.size())) {
+        spheres.push_back(sphere);
+      }
+      else {
+        spheres[id] = sphere;
+      }
+      return id;
+    }
+
+    void remove(int id) {
+      bvh.remove(id);
+      spheres[id] = nullptr;
+    }
+
+    void move(int id, Point3 center) {
+      spheres[id]->center = center;
+      bvh.update(id);
+    }
+
+    void resize(int id, double radius) {
+      spheres[id]->radius = radius;
+      bvh.update(id);
+    }
+
+    // swapping the material doesn't change the geometry, so the BVH is
+    // left alone
+    void set_material(int id, shared_ptr<Material> m) {
+      spheres[id]->mat_ptr = m;
+    }
+
+    // ACCESSORS //
+
+    // one past the largest id handed out so far
+    int size() const {
+      return static_cast<int>(spheres.size());
+    }
+
+    // the sphere with the given id (nullptr if it was removed)
+    shared_ptr<Sphere> sphere(int id) const {
+      return spheres[id];
+    }
+
+    // what to render
+    const Hittable& world() const {
+      return bvh;
+    }
+
+    const BVH& accel() const {
+      return bvh;
+    }
+
+  // FIELDS //
+  private:
+    // spheres by id; the ids are the BVH's handles
+    std::vector<shared_ptr<Sphere>> spheres;
+    BVH bvh;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "RTWeekend.hpp"
+
+#include "Hittable_List.hpp"
+#include "Sphere.hpp"
+#include "Material.hpp"
+
+// return the scene used for development
+Hittable_List dev_scene() {
+  Hittable_List world;
+
+  auto material_ground = make_shared<Lambertian>(Colour(0.8, 0.8, 0.0));
+  auto material_center = make_shared<Lambertian>(Colour(0.1, 0.2, 0.5));
+  auto material_left   = make_shared<Dielectric>(1.5);
+  auto material_right  = make_shared<Metal>(Colour(0.8, 0.6, 0.2), 0.0);
+
+  // the ground is round
+  world.add(make_shared<Sphere>(Point3(0, -100.5, -1), 100, material_ground));
+  // pondering my orbs
+  world.add(make_shared<Sphere>(Point3( 0, 0, -1),  0.5, material_center));
+  world.add(make_shared<Sphere>(Point3(-1, 0, -1),  0.5, material_left));
+  world.add(make_shared<Sphere>(Point3(-1, 0, -1), -0.45, material_left));
+  world.add(make_shared<Sphere>(Point3( 1, 0, -1),  0.5, material_right));
+
+  return world;
+}
+
+// produce a scene with lots of random spheres, optionally on a textured
+// ground
+Hittable_List random_scene(shared_ptr<Texture> ground = nullptr) {
+  Hittable_List world;
+
+  // radii
+  auto ground_radius = 1000.0;
+  auto small_radius  = 0.2;
+  auto big_radius    = 1.0;
+
+  // the ground is (still) round
+  auto ground_material = ground
+    ? make_shared<Lambertian>(ground)
+    : make_shared<Lambertian>(Colour(0.5, 0.5, 0.5));
+  world.add(make_shared<Sphere>(Point3(0, -1000, 0), ground_radius, ground_material));
+
+
+  // generate a bunch of random small spheres
+  for (int a = -11; a < 11; a++) {
+    for (int b = -11; b < 11; b++) {
+      auto choose_mat = random_double();
+
+      // random center for the sphere
+      Point3 center(
+          a + 0.9 * random_double(),
+          0.2,
+          b + 0.9 * random_double()
+          );
+
+      // make sure the spheres are at least a bit in the camera view
+      if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
+        shared_ptr<Material> sphere_material;
+
+        // determine the randomly picked material
+        if (choose_mat < 0.8) {
+          // diffuse (80% likely)
+          auto albedo = Colour::random() * Colour::random();
+          sphere_material = make_shared<Lambertian>(albedo);
+        }
+        else if (choose_mat < 0.95) {
+          // metal (15% likely)
+          auto albedo = Colour::random(0.5, 1);
+          auto fuzz = random_double(0, 0.5);
+          sphere_material = make_shared<Metal>(albedo, fuzz);
+        }
+        else {
+          // glass (5% likely)
+          sphere_material = make_shared<Dielectric>(1.5);
+        }
+
+        // add a new sphere with the material
+        world.add(make_shared<Sphere>(center, small_radius, sphere_material));
+      }
+    }
+  }
+
+  // add 3 big spheres, one of each material type
+  auto material1 = make_shared<Dielectric>(1.5);
+  world.add(make_shared<Sphere>(Point3(0, 1, 0), big_radius, material1));
+
+  auto material2 = make_shared<Lambertian>(Colour(0.4, 0.2, 0.1));
+  world.add(make_shared<Sphere>(Point3(-4, 1, 0), big_radius, material2));
+
+  auto material3 = make_shared<Metal>(Colour(0.7, 0.6, 0.5), 0.0);
+  world.add(make_shared<Sphere>(Point3(4, 1, 0), big_radius, material3));
+
+  return world;
+}
+
+#endif
@@ -0,0 +1,703 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "RTWeekend.hpp"
+
+#include "Hittable_List.hpp"
+#include "Scene.hpp"
+#include "Scenes.hpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Render.hpp"
+#include "Texture.hpp"
+#include "Texture_Cache.hpp"
+#include "Thread_Pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Render server: a long-running process taking render jobs, one per line,
+// from stdin or from clients of a local Unix socket.
+//
+//   render id=<name> out=<file.ppm> [key=value ...]
+//   add scene=<name> center=<x,y,z> radius=<r> material=<material>
+//   move scene=<name> id=<sphere> center=<x,y,z>
+//   resize scene=<name> id=<sphere> radius=<r>
+//   remove scene=<name> id=<sphere>
+//   material scene=<name> id=<sphere> material=<material>
+//   stats
+//   quit
+//
+// where a <material> is one of `lambertian:r,g,b`, `metal:r,g,b,fuzz`,
+// `dielectric:ri`, `lambertian:checker:r,g,b,r,g,b`, or
+// `lambertian:image:<file.rttex>[@<pixels>]` (a texture file made by `mktex`,
+// read from the first mip level no more than <pixels> across, e.g. about as
+// large as the image will be seen; all of it by default).
+// Image textures of all scenes share one bounded tile cache, whose counters
+// `stats` answers with.
+//
+// Scenes (and their BVHs) are built once and kept across jobs; the jobs
+// themselves are split into bands of scanlines, which run on a shared pool of
+// worker threads in order of job priority. Each finished job is answered on
+// the line it came from with either
+//
+//   done <id> <out> <seconds>
+//   error <id> <message>
+//
+// (also when the job is refused, e.g. for being larger than `max_job_size`,
+// or couldn't be started).
+//
+// Edits wait for the jobs already running on their scene to finish (jobs on
+// other scenes carry on, and new ones on it wait for the edit), then update
+// the cached scene in place, and are answered with `ok <sphere>` or
+// `error - <message>`.
+
+// a single render job, and its defaults
+struct render_job {
+  std::string id;
+  std::string scene = "random";
+  int width = 1200;
+  int height = 0;         // 0 means width / aspect ratio
+  int spp = 16;
+  int max_depth = 50;
+  int priority = 0;       // higher runs first
+
+  bool crop = false;
+  int crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0;
+
+  Point3 look_from = Point3(13, 2, 3);
+  Point3 look_at = Point3(0, 0, 0);
+  Vec3 vup = Vec3(0, 1, 0);
+  double vfov = 20;
+  double aperture = 0.1;
+  double focus_dist = 10.0;
+
+  std::string out;        // output image
+  std::string acc;        // optional accumulation buffer
+};
+
+// the largest jobs taken: one would otherwise tie up (or run the server out
+// of) memory and workers for everyone else
+const int max_job_size = 16384;       // pixels across, or down
+const int max_job_spp = 1 << 20;
+const int max_job_depth = 1000;
+
+// parse an "x,y,z" triple
+inline bool parse_vec3(const std::string& s, Vec3& v) {
+  return sscanf(s.c_str(), "%lf,%lf,%lf", &v[0], &v[1], &v[2]) == 3;
+}
+
+// Parse the `key=value` arguments of a `render` line into `job`. On failure,
+// `err` says what was wrong.
+bool parse_job(std::istream& args, render_job& job, std::string& err) {
+  std::string kv;
+  while (args >> kv) {
+    auto eq = kv.find('=');
+    if (eq == std::string::npos) {
+      err = "expected key=value, got '" + kv + "'";
+      return false;
+    }
+    auto key = kv.substr(0, eq);
+    auto val = kv.substr(eq + 1);
+
+    bool ok = true;
+    if (key == "id")            job.id = val;
+    else if (key == "scene")    job.scene = val;
+    else if (key == "width")    ok = sscanf(val.c_str(), "%d", &job.width) == 1;
+    else if (key == "height")   ok = sscanf(val.c_str(), "%d", &job.height) == 1;
+    else if (key == "spp")      ok = sscanf(val.c_str(), "%d", &job.spp) == 1;
+    else if (key == "depth")    ok = sscanf(val.c_str(), "%d", &job.max_depth) == 1;
+    else if (key == "priority") ok = sscanf(val.c_str(), "%d", &job.priority) == 1;
+    else if (key == "crop") {
+      job.crop = true;
+      ok = sscanf(val.c_str(), "%d,%d,%d,%d",
+                  &job.crop_x, &job.crop_y, &job.crop_w, &job.crop_h) == 4;
+    }
+    else if (key == "lookfrom") ok = parse_vec3(val, job.look_from);
+    else if (key == "lookat")   ok = parse_vec3(val, job.look_at);
+    else if (key == "vup")      ok = parse_vec3(val, job.vup);
+    else if (key == "vfov")     ok = sscanf(val.c_str(), "%lf", &job.vfov) == 1;
+    else if (key == "aperture") ok = sscanf(val.c_str(), "%lf", &job.aperture) == 1;
+    else if (key == "focus")    ok = sscanf(val.c_str(), "%lf", &job.focus_dist) == 1;
+    else if (key == "out")      job.out = val;
+    else if (key == "acc")      job.acc = val;
+    else {
+      err = "unknown key '" + key + "'";
+      return false;
+    }
+
+    if (!ok) {
+      err = "bad value for '" + key + "'";
+      return false;
+    }
+  }
+
+  if (job.id.empty() || job.out.empty()) {
+    err = "a job needs an id and an out file";
+    return false;
+  }
+  if (job.width < 2 || job.width > max_job_size) {
+    err = "width must be from 2 to " + std::to_string(max_job_size);
+    return false;
+  }
+  if (job.height == 0) {
+    job.height = static_cast<int>(job.width / (3.0 / 2.0));
+  }
+  if (job.height < 2 || job.height > max_job_size) {
+    err = "height must be from 2 to " + std::to_string(max_job_size);
+    return false;
+  }
+  if (job.spp < 1 || job.spp > max_job_spp
+      || job.max_depth < 1 || job.max_depth > max_job_depth) {
+    err = "spp must be from 1 to " + std::to_string(max_job_spp)
+        + ", and depth from 1 to " + std::to_string(max_job_depth);
+    return false;
+  }
+  if (!job.crop) {
+    job.crop_w = job.width;
+    job.crop_h = job.height;
+  }
+  // (written so as not to overflow)
+  else if (job.crop_x < 0 || job.crop_y < 0 || job.crop_w <= 0 || job.crop_h <= 0
+           || job.crop_x > job.width - job.crop_w
+           || job.crop_y > job.height - job.crop_h) {
+    err = "crop window must lie within the image";
+    return false;
+  }
+  return true;
+}
+
+// parse a material, e.g. "metal:0.7,0.6,0.5,0.0"; nullptr if it's malformed
+// (or names an image texture which can't be opened through `textures`)
+inline shared_ptr<Material> parse_material(
+    const std::string& s, const shared_ptr<Texture_Cache>& textures = nullptr
+) {
+  const std::string image = "lambertian:image:";
+  if (s.compare(0, image.size(), image) == 0) {
+    auto path = s.substr(image.size());
+
+    // an optional size hint, picking the mip level
+    int size = 0;
+    auto at = path.rfind('@');
+    if (at != std::string::npos) {
+      char end;
+      if (sscanf(path.c_str() + at + 1, "%d%c", &size, &end) != 1 || size < 1) {
+        return nullptr;
+      }
+      path.erase(at);
+    }
+
+    auto file = textures ? textures->open(path) : nullptr;
+    if (!file) {
+      return nullptr;
+    }
+    int level = size > 0 ? file->level_for(size) : 0;
+    return make_shared<Lambertian>(make_shared<Image_Texture>(textures, file, level));
+  }
+
+  double a, b, c, d, e, f;
+  if (sscanf(s.c_str(), "lambertian:checker:%lf,%lf,%lf,%lf,%lf,%lf",
+             &a, &b, &c, &d, &e, &f) == 6) {
+    return make_shared<Lambertian>(
+        make_shared<Checker_Texture>(Colour(a, b, c), Colour(d, e, f)));
+  }
+  if (sscanf(s.c_str(), "lambertian:%lf,%lf,%lf", &a, &b, &c) == 3) {
+    return make_shared<Lambertian>(Colour(a, b, c));
+  }
+  if (sscanf(s.c_str(), "metal:%lf,%lf,%lf,%lf", &a, &b, &c, &d) == 4) {
+    return make_shared<Metal>(Colour(a, b, c), d);
+  }
+  if (sscanf(s.c_str(), "dielectric:%lf", &a) == 1) {
+    return make_shared<Dielectric>(a);
+  }
+  return nullptr;
+}
+
+// Scenes by name, built on first use and kept for every later job
+class Scene_Cache {
+  public:
+    // the named scene, or nullptr if there's no such scene
+    shared_ptr<Scene> get(const std::string& name) {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      auto it = scenes.find(name);
+      if (it != scenes.end()) {
+        return it->second;
+      }
+
+      // the scenes are laid out with `rand()`, so reset it to its default
+      // seed to get the same scene as a stand-alone render
+      shared_ptr<Scene> scene;
+      srand(1);
+      if (name == "random") {
+        scene = make_shared<Scene>(random_scene());
+      }
+      else if (name == "dev") {
+        scene = make_shared<Scene>(dev_scene());
+      }
+      else {
+        return nullptr;
+      }
+
+      scenes[name] = scene;
+      return scene;
+    }
+
+  private:
+    std::mutex mtx;
+    std::map<std::string, shared_ptr<Scene>> scenes;
+};
+
+class Render_Server {
+  public:
+    // where replies to a job's client go
+    using reply_fn = std::function<void(const std::string&)>;
+
+    explicit Render_Server(int n_threads, size_t texture_cache_bytes = 64 << 20)
+      : textures(make_shared<Texture_Cache>(texture_cache_bytes)), pool(n_threads) {}
+
+    // METHODS //
+
+    // Handle one request line. Returns false on `quit`.
+    //
+    // Whatever goes wrong with a request (e.g. running out of memory for a
+    // job) is answered with an error; it doesn't take the server down.
+    bool handle(const std::string& line, const reply_fn& reply) {
+      try {
+        return handle_request(line, reply);
+      }
+      catch (const std::exception& e) {
+        reply("error " + request_id(line) + ' ' + e.what());
+        return true;
+      }
+    }
+
+    // Serve request lines from `in`, answering on `out`, until `quit` or the
+    // end of the input
+    void serve_stream(std::istream& in, std::ostream& out) {
+      std::mutex out_mtx;
+      auto reply = [&out, &out_mtx](const std::string& msg) {
+        std::lock_guard<std::mutex> lock(out_mtx);
+        out << msg << std::endl;
+      };
+
+      std::string line;
+      while (std::getline(in, line) && handle(line, reply)) {
+      }
+
+      // jobs still running reply through `out_mtx`, so wait for them
+      wait_idle();
+    }
+
+    // Serve clients of a Unix socket at `path`, until one of them says
+    // `quit`. Returns false if the socket couldn't be set up.
+    bool serve_socket(const std::string& path) {
+      int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (listen_fd < 0) {
+        return false;
+      }
+
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      if (path.size() >= sizeof(addr.sun_path)) {
+        close(listen_fd);
+        return false;
+      }
+      path.copy(addr.sun_path, path.size());
+      unlink(path.c_str());
+
+      if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+          || listen(listen_fd, 8) < 0) {
+        close(listen_fd);
+        return false;
+      }
+
+      while (!quitting) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+          continue;   // interrupted, or shut down by `quit`
+        }
+
+        std::lock_guard<std::mutex> lock(clients_mtx);
+        reap_clients();
+        clients.emplace_back();
+        auto& c = clients.back();
+        c.fd = fd;
+        c.thread = std::thread(&Render_Server::serve_client, this,
+                               std::ref(c), listen_fd);
+      }
+
+      close(listen_fd);
+      unlink(path.c_str());
+
+      // hang up on the other clients (their replies can still be sent), and
+      // wait for their threads before anything they use goes away
+      {
+        std::lock_guard<std::mutex> lock(clients_mtx);
+        for (auto& c : clients) {
+          if (c.fd >= 0) {
+            shutdown(c.fd, SHUT_RD);
+          }
+        }
+      }
+      for (auto& c : clients) {
+        c.thread.join();
+      }
+      clients.clear();
+
+      wait_idle();
+      return true;
+    }
+
+    // block until every submitted job has finished
+    void wait_idle() {
+      std::unique_lock<std::mutex> lock(idle_mtx);
+      idle.wait(lock, [this] { return jobs_running == 0; });
+    }
+
+  private:
+    // handle one request line, for `handle`
+    bool handle_request(const std::string& line, const reply_fn& reply) {
+      std::istringstream in(line);
+      std::string cmd;
+      if (!(in >> cmd)) {
+        return true;    // blank line
+      }
+
+      if (cmd == "quit") {
+        return false;
+      }
+      if (cmd == "stats") {
+        auto st = textures->stats();
+        reply("stats texture-hits=" + std::to_string(st.hits)
+              + " texture-misses=" + std::to_string(st.misses)
+              + " texture-evictions=" + std::to_string(st.evictions)
+              + " texture-bytes=" + std::to_string(st.bytes));
+        return true;
+      }
+      if (cmd != "render") {
+        edit(cmd, in, reply);
+        return true;
+      }
+
+      render_job job;
+      std::string err;
+      if (!parse_job(in, job, err)) {
+        reply("error " + (job.id.empty() ? "-" : job.id) + ' ' + err);
+        return true;
+      }
+
+      auto world = scenes.get(job.scene);
+      if (!world) {
+        reply("error " + job.id + " unknown scene '" + job.scene + "'");
+        return true;
+      }
+
+      submit(job, world, reply);
+      return true;
+    }
+
+    // the job id of a `render` line, or "-" for anything else
+    static std::string request_id(const std::string& line) {
+      std::istringstream in(line);
+      std::string arg;
+      if (!(in >> arg) || arg != "render") {
+        return "-";
+      }
+      while (in >> arg) {
+        if (arg.compare(0, 3, "id=") == 0 && arg.size() > 3) {
+          return arg.substr(3);
+        }
+      }
+      return "-";
+    }
+
+    // Handle a scene edit command, with its `key=value` arguments in `args`
+    void edit(const std::string& cmd, std::istream& args, const reply_fn& reply) {
+      std::map<std::string, std::string> kv;
+      std::string arg;
+      while (args >> arg) {
+        auto eq = arg.find('=');
+        if (eq == std::string::npos) {
+          reply("error - expected key=value, got '" + arg + "'");
+          return;
+        }
+        kv[arg.substr(0, eq)] = arg.substr(eq + 1);
+      }
+
+      if (cmd != "add" && cmd != "move" && cmd != "resize"
+          && cmd != "remove" && cmd != "material") {
+        reply("error - unknown command '" + cmd + "'");
+        return;
+      }
+
+      auto name = kv.count("scene") ? kv["scene"] : "random";
+      auto scene = scenes.get(name);
+      if (!scene) {
+        reply("error - unknown scene '" + name + "'");
+        return;
+      }
+
+      Point3 center;
+      double radius = 0;
+      shared_ptr<Material> mat;
+      bool need_center = cmd == "add" || cmd == "move";
+      bool need_radius = cmd == "add" || cmd == "resize";
+      bool need_material = cmd == "add" || cmd == "material";
+      if ((need_center && !parse_vec3(kv["center"], center))
+          || (need_radius && sscanf(kv["radius"].c_str(), "%lf", &radius) != 1)
+          || (need_material && !(mat = parse_material(kv["material"], textures)))) {
+        reply("error - bad or missing arguments for '" + cmd + "'");
+        return;
+      }
+
+      // jobs in flight may be using the scene, so let them finish first
+      scene_edit exclusive(*this, name);
+
+      // the sphere to edit, if the command is about an existing one (checked
+      // only now, as an edit before this one may have removed it)
+      int id = -1;
+      if (cmd != "add") {
+        if (!kv.count("id") || sscanf(kv["id"].c_str(), "%d", &id) != 1
+            || id < 0 || id >= scene->size() || !scene->sphere(id)) {
+          reply("error - no such sphere");
+          return;
+        }
+      }
+
+      if (cmd == "add")           id = scene->add_sphere(center, radius, mat);
+      else if (cmd == "move")     scene->move(id, center);
+      else if (cmd == "resize")   scene->resize(id, radius);
+      else if (cmd == "remove")   scene->remove(id);
+      else                        scene->set_material(id, mat);
+
+      reply("ok " + std::to_string(id));
+    }
+
+    // a job in flight, shared by all of its bands
+    struct job_state {
+      job_state(const render_job& job, shared_ptr<const Scene> world,
+                int bands, reply_fn reply)
+        : job(job), world(world),
+          cam(job.look_from, job.look_at, job.vup, job.vfov,
+              static_cast<double>(job.width) / job.height,
+              job.aperture, job.focus_dist),
+          // crops are given top-down, the framebuffer counts bottom-up
+          fb(job.width, job.height, job.crop_x,
+             job.height - job.crop_y - job.crop_h, job.crop_w, job.crop_h),
+          bands_left(bands), started(std::chrono::steady_clock::now()),
+          reply(std::move(reply))
+      {}
+
+      render_job job;
+      shared_ptr<const Scene> world;
+      Camera cam;
+      Framebuffer fb;
+      std::atomic<int> bands_left;
+      std::chrono::steady_clock::time_point started;
+      reply_fn reply;
+    };
+
+    // jobs in flight on a scene, and whether it's being edited
+    struct scene_use {
+      int jobs_running = 0;
+      bool editing = false;
+    };
+
+    // Exclusive use of a scene for an edit, for as long as this is around:
+    // waits for the jobs running on it to finish, and holds off new ones
+    struct scene_edit {
+      scene_edit(Render_Server& server, const std::string& name)
+        : server(server), name(name)
+      {
+        std::unique_lock<std::mutex> lock(server.idle_mtx);
+        auto& use = server.scene_uses[name];
+        // (one edit at a time)
+        server.idle.wait(lock, [&use] { return !use.editing; });
+        use.editing = true;
+        server.idle.wait(lock, [&use] { return use.jobs_running == 0; });
+      }
+
+      ~scene_edit() {
+        std::lock_guard<std::mutex> lock(server.idle_mtx);
+        server.scene_uses[name].editing = false;
+        server.idle.notify_all();
+      }
+
+      Render_Server& server;
+      std::string name;
+    };
+
+    // split `job` into bands of scanlines, and queue them on the pool
+    void submit(const render_job& job, shared_ptr<const Scene> world,
+                reply_fn reply) {
+      const int band_height = 8;
+
+      auto state = make_shared<job_state>(
+          job, world, (job.crop_h + band_height - 1) / band_height,
+          std::move(reply));
+
+      {
+        // (not while the scene is being edited)
+        std::unique_lock<std::mutex> lock(idle_mtx);
+        auto& use = scene_uses[job.scene];
+        idle.wait(lock, [&use] { return !use.editing; });
+        ++use.jobs_running;
+        ++jobs_running;
+      }
+
+      // top bands first, like a stand-alone render
+      auto& fb = state->fb;
+      for (int j1 = fb.y1(); j1 > fb.y0; j1 -= band_height) {
+        int j0 = j1 - band_height > fb.y0 ? j1 - band_height : fb.y0;
+        pool.submit(job.priority, [this, state, j0, j1] {
+          Generic_Sampler sample{ state->world->world(), state->cam,
+                                  state->job.max_depth };
+          render_rows(sample, state->fb, j0, j1, state->job.spp);
+          // the last band to finish writes out the job
+          if (--state->bands_left == 0) {
+            finish(*state);
+          }
+        });
+      }
+    }
+
+    // write out a finished job, and tell its client
+    void finish(job_state& state) {
+      const auto& job = state.job;
+
+      std::ofstream out(job.out);
+      state.fb.write_ppm(out);
+      out.close();
+
+      if (!out || (!job.acc.empty() && !state.fb.save(job.acc))) {
+        state.reply("error " + job.id + " could not write the output");
+      }
+      else {
+        auto secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - state.started).count();
+        state.reply("done " + job.id + ' ' + job.out + ' ' + std::to_string(secs));
+      }
+
+      std::lock_guard<std::mutex> lock(idle_mtx);
+      --scene_uses[job.scene].jobs_running;
+      --jobs_running;
+      idle.notify_all();
+    }
+
+    // a connected socket client, and the thread serving it
+    struct client {
+      int fd = -1;        // -1 once the thread is done with it
+      std::thread thread;
+    };
+
+    // join the threads of clients which have gone, with `clients_mtx` held
+    void reap_clients() {
+      for (auto it = clients.begin(); it != clients.end();) {
+        if (it->fd < 0) {
+          it->thread.join();
+          it = clients.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+
+    // per-connection thread: serve request lines from one socket client,
+    // until it hangs up (or is hung up on) or says `quit`
+    void serve_client(client& c, int listen_fd) {
+      int fd = c.fd;
+
+      // replies may outlive this thread (and each other), so the connection
+      // is closed once the last one is gone
+      struct connection {
+        int fd;
+        std::mutex mtx;
+        ~connection() { close(fd); }
+      };
+      auto conn = make_shared<connection>();
+      conn->fd = fd;
+
+      auto reply = [conn](const std::string& msg) {
+        std::lock_guard<std::mutex> lock(conn->mtx);
+        auto line = msg + '\n';
+        // the client may be gone already; nothing to do about that
+        auto n = send(conn->fd, line.data(), line.size(), MSG_NOSIGNAL);
+        (void) n;
+      };
+
+      // on the way out, mark the client gone (before `conn` can close its fd)
+      struct gone {
+        Render_Server& server;
+        client& c;
+        ~gone() {
+          std::lock_guard<std::mutex> lock(server.clients_mtx);
+          c.fd = -1;
+        }
+      } mark_gone{ *this, c };
+
+      std::string pending;
+      char buf[4096];
+      while (!quitting) {
+        auto n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          return;
+        }
+        pending.append(buf, n);
+
+        size_t nl;
+        while (!quitting && (nl = pending.find('\n')) != std::string::npos) {
+          auto line = pending.substr(0, nl);
+          pending.erase(0, nl + 1);
+
+          if (!handle(line, reply)) {
+            // stop taking clients; this wakes up the blocked `accept`
+            quitting = true;
+            shutdown(listen_fd, SHUT_RDWR);
+            return;
+          }
+        }
+      }
+    }
+
+  // FIELDS //
+  private:
+    Scene_Cache scenes;
+
+    // decoded tiles of every image texture in every scene
+    shared_ptr<Texture_Cache> textures;
+
+    // set once a socket client says `quit`
+    std::atomic<bool> quitting{false};
+
+    // socket clients, whose threads are joined once they've gone
+    std::mutex clients_mtx;
+    std::list<client> clients;
+
+    // jobs in flight, in all and by scene name
+    std::mutex idle_mtx;
+    std::condition_variable idle;
+    int jobs_running = 0;
+    std::map<std::string, scene_use> scene_uses;
+
+    // declared last, so its workers stop before the rest is torn down
+    Thread_Pool pool;
+};
+
+#endif
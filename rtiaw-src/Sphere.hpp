@@ -14,6 +14,25 @@ class Sphere : public Hittable {
     virtual bool hit(
         const Ray& r, double t_min, double t_max, hit_record& rec) const override;
 
+    virtual bool occluded(
+        const Ray& r, double t_min, double t_max) const override;
+
+    virtual bool bounding_box(AABB& output_box) const override;
+
+    // the two halves of `hit`: finding the nearest root within
+    // [t_min, t_max], and filling in the record for a hit at `t`
+    bool nearest_root(const Ray& r, double t_min, double t_max, double& t) const;
+    void fill_record(const Ray& r, double t, hit_record& rec) const;
+
+    // surface coordinates of `p` on the unit sphere: u goes around the y
+    // axis from x = -1, and v from y = -1 up to y = 1, both within [0, 1]
+    static void get_sphere_uv(const Point3& p, double& u, double& v) {
+      auto theta = acos(-p.y());
+      auto phi = atan2(-p.z(), p.x()) + pi;
+      u = phi / (2 * pi);
+      v = theta / pi;
+    }
+
   public:
     Point3 center;
     double radius;
@@ -21,6 +40,15 @@ class Sphere : public Hittable {
 };
 
 bool Sphere::hit (const Ray& r, double t_min, double t_max, hit_record& rec) const {
+  double root;
+  if (!nearest_root(r, t_min, t_max, root)) {
+    return false;
+  }
+  fill_record(r, root, rec);
+  return true;
+}
+
+bool Sphere::nearest_root(const Ray& r, double t_min, double t_max, double& t) const {
   Vec3 oc = r.origin() - center;
 
   // terms of the quadratic for t, simplified through b = 2h
@@ -45,14 +73,48 @@ bool Sphere::hit (const Ray& r, double t_min, double t_max, hit_record& rec) con
     }
   }
 
+  t = root;
+  return true;
+}
+
+void Sphere::fill_record(const Ray& r, double t, hit_record& rec) const {
   // store the result in the given `hit_record`
-  rec.t = root;
+  rec.t = t;
   rec.p = r.at(rec.t);
   Vec3 outward_normal = (rec.p - center) / radius;
   rec.set_face_normal(r, outward_normal);
+  get_sphere_uv(outward_normal, rec.u, rec.v);
   // set the material used to this sphere's material
   rec.mat_ptr = mat_ptr;
+}
+
+bool Sphere::occluded(const Ray& r, double t_min, double t_max) const {
+  Vec3 oc = r.origin() - center;
+
+  // same quadratic as in `hit`
+  auto a = r.direction().length_squared();
+  auto half_b = dot(oc, r.direction());
+  auto c = oc.length_squared() - radius * radius;
+
+  auto discriminant = half_b * half_b - a * c;
+  if (discriminant < 0) {
+    return false;
+  }
+  auto sqrt_d = sqrt(discriminant);
+
+  // either root within [t_min, t_max] blocks the ray; no record to fill in
+  auto root = (-half_b - sqrt_d) / a;
+  if (t_min <= root && root <= t_max) {
+    return true;
+  }
+  root = (-half_b + sqrt_d) / a;
+  return t_min <= root && root <= t_max;
+}
 
+bool Sphere::bounding_box(AABB& output_box) const {
+  // (the radius is negative for hollow spheres)
+  auto r = fabs(radius);
+  output_box = AABB(center - Vec3(r, r, r), center + Vec3(r, r, r));
   return true;
 }
 
@@ -0,0 +1,138 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "RTWeekend.hpp"
+
+#include "Texture_Cache.hpp"
+#include "Tiled_Image.hpp"
+
+// A colour varying over a surface, e.g. the albedo of a material
+class Texture {
+  public:
+    // the colour at surface coordinates (`u`, `v`), hit at `p`
+    virtual Colour value(double u, double v, const Point3& p) const = 0;
+};
+
+// the same colour everywhere
+class Solid_Colour : public Texture {
+  public:
+    Solid_Colour(const Colour& c) : colour_value(c) {}
+
+    virtual Colour value(double, double, const Point3&) const override {
+      return colour_value;
+    }
+
+  public:
+    Colour colour_value;
+};
+
+// a 3D checkerboard of two textures, with cells 1/`scale` across
+class Checker_Texture : public Texture {
+  public:
+    Checker_Texture(shared_ptr<Texture> even, shared_ptr<Texture> odd, double scale = 10)
+      : even(even), odd(odd), scale(scale) {}
+
+    Checker_Texture(const Colour& even, const Colour& odd, double scale = 10)
+      : Checker_Texture(make_shared<Solid_Colour>(even),
+                        make_shared<Solid_Colour>(odd), scale) {}
+
+    virtual Colour value(double u, double v, const Point3& p) const override {
+      auto sines = sin(scale * p.x()) * sin(scale * p.y()) * sin(scale * p.z());
+      return sines < 0 ? odd->value(u, v, p) : even->value(u, v, p);
+    }
+
+  public:
+    shared_ptr<Texture> even;
+    shared_ptr<Texture> odd;
+    double scale;
+};
+
+// An image mapped onto the surface, sampled (bilinearly) from one level of a
+// tiled texture file through a `Texture_Cache`.
+//
+// Rays carry no footprint to pick a mip level with per hit, so the level is
+// fixed per texture: e.g. `level_for(n)` for a surface about `n` pixels
+// across on screen. Lower levels take a fraction of the cache.
+//
+// Each thread keeps hold of the last few tiles it read (of any image
+// texture), as the next lookup most likely falls in one of them too: only
+// lookups which move on to other tiles go through the cache, and its lock
+// (and only those are counted in its stats).
+class Image_Texture : public Texture {
+  public:
+    Image_Texture(
+        shared_ptr<Texture_Cache> cache, shared_ptr<const Tiled_Image> image,
+        int level = 0
+    ) : cache(cache), image(image), level(level) {}
+
+    virtual Colour value(double u, double v, const Point3&) const override {
+      // texel coordinates, with the image repeating in both directions
+      // (and stored top row first)
+      auto x = (u - floor(u)) * image->width(level) - 0.5;
+      auto y = (1.0 - (v - floor(v))) * image->height(level) - 0.5;
+
+      int x0 = static_cast<int>(floor(x));
+      int y0 = static_cast<int>(floor(y));
+      auto fx = x - x0;
+      auto fy = y - y0;
+
+      // the four texels around (x, y)
+      auto texel = [this](int ix, int iy) {
+        int w = image->width(level), h = image->height(level);
+        int sx = ((ix % w) + w) % w;
+        int sy = ((iy % h) + h) % h;
+        int ts = image->tile_size();
+        return get_tile(sx / ts, sy / ts).texel(sx % ts, sy % ts);
+      };
+
+      return (1 - fy) * ((1 - fx) * texel(x0, y0) + fx * texel(x0 + 1, y0))
+           + fy * ((1 - fx) * texel(x0, y0 + 1) + fx * texel(x0 + 1, y0 + 1));
+    }
+
+  private:
+    // the tile at (`tx`, `ty`), valid until this thread's next call
+    const Texture_Cache::tile& get_tile(int tx, int ty) const {
+      // (image ids are never reused, so this can't be mistaken for a tile of
+      //  an image which is gone)
+      struct recent_tile {
+        uint64_t image;
+        int level, tx, ty;
+        shared_ptr<const Texture_Cache::tile> t;
+      };
+      // by the parity of the tile's position, so the (up to) four tiles
+      // around a tile corner, which bilinear lookups there straddle, can all
+      // be held at once
+      static thread_local recent_tile recent[4];
+
+      auto& r = recent[(tx & 1) | (ty & 1) << 1];
+      if (!r.t || r.image != image->id || r.level != level
+          || r.tx != tx || r.ty != ty) {
+        r = { image->id, level, tx, ty, cache->get(*image, level, tx, ty) };
+      }
+      return *r.t;
+    }
+
+  public:
+    shared_ptr<Texture_Cache> cache;
+    shared_ptr<const Tiled_Image> image;
+    int level;
+};
+
+// Another texture projected straight down onto the xz plane, repeating every
+// `scale` units: for large, flat surfaces like the ground, whose own surface
+// coordinates would stretch it
+class Planar_Texture : public Texture {
+  public:
+    Planar_Texture(shared_ptr<Texture> texture, double scale)
+      : texture(texture), scale(scale) {}
+
+    virtual Colour value(double, double, const Point3& p) const override {
+      return texture->value(p.x() / scale, -p.z() / scale, p);
+    }
+
+  public:
+    shared_ptr<Texture> texture;
+    double scale;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "RTWeekend.hpp"
+
+#include "Tiled_Image.hpp"
+
+#include <array>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A bounded, thread-safe cache of decoded texture tiles, shared by all the
+// image textures of a render (or of a whole server).
+//
+// Tiles are decoded to linear colour on first use, straight from the mapped
+// texture file, whose pages are then dropped again: the memory taken by
+// textures is the cache's capacity, however large the files are. Once full,
+// the least recently used tiles are evicted.
+//
+// A tile stays valid for as long as someone holds on to it, even if it has
+// been evicted in the meantime.
+class Texture_Cache {
+  public:
+    // a decoded tile: tile size x tile size linear RGB texels, row-major
+    struct tile {
+      int size;
+      std::vector<float> texels;
+
+      Colour texel(int x, int y) const {
+        auto t = &texels[(static_cast<size_t>(y) * size + x) * 3];
+        return Colour(t[0], t[1], t[2]);
+      }
+    };
+
+    struct cache_stats {
+      long hits;
+      long misses;
+      long evictions;
+      // decoded bytes held, and the most allowed
+      size_t bytes;
+      size_t capacity;
+    };
+
+    // CONSTRUCTORS //
+    explicit Texture_Cache(size_t capacity_bytes) : capacity(capacity_bytes) {}
+
+    Texture_Cache(const Texture_Cache&) = delete;
+    Texture_Cache& operator=(const Texture_Cache&) = delete;
+
+    // METHODS //
+
+    // map the texture file at `path`, sharing it if it's open already;
+    // nullptr if it can't be opened
+    shared_ptr<const Tiled_Image> open(const std::string& path) {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      auto& image = images[path];
+      if (auto open = image.lock()) {
+        return open;
+      }
+      auto fresh = make_shared<Tiled_Image>();
+      if (!fresh->open(path)) {
+        images.erase(path);
+        return nullptr;
+      }
+      image = fresh;
+      return fresh;
+    }
+
+    // the tile at (`tx`, `ty`) of a level of `image`, decoding it if needed
+    shared_ptr<const tile> get(const Tiled_Image& image, int level, int tx, int ty) {
+      key k{ image.id, level, tx, ty };
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(k);
+        if (it != index.end()) {
+          ++hits;
+          // now the most recently used
+          lru.splice(lru.begin(), lru, it->second);
+          return it->second->second;
+        }
+        ++misses;
+      }
+
+      // decode outside of the lock, so other threads aren't held up by it
+      auto t = decode(image, level, tx, ty);
+
+      std::lock_guard<std::mutex> lock(mtx);
+      auto it = index.find(k);
+      if (it != index.end()) {
+        // another thread got there first
+        return it->second->second;
+      }
+      lru.emplace_front(k, t);
+      index[k] = lru.begin();
+      bytes += tile_footprint(*t);
+      evict();
+      return t;
+    }
+
+    // ACCESSORS //
+
+    cache_stats stats() const {
+      std::lock_guard<std::mutex> lock(mtx);
+      return { hits, misses, evictions, bytes, capacity };
+    }
+
+  private:
+    struct key {
+      uint64_t image;
+      int level, tx, ty;
+
+      bool operator==(const key& o) const {
+        return image == o.image && level == o.level && tx == o.tx && ty == o.ty;
+      }
+    };
+
+    struct key_hash {
+      size_t operator()(const key& k) const {
+        uint64_t h = k.image;
+        h = h * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t>(k.level);
+        h = h * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t>(k.tx);
+        h = h * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t>(k.ty);
+        return static_cast<size_t>(splitmix64(h));
+      }
+    };
+
+    using entry = std::pair<key, shared_ptr<const tile>>;
+
+    static size_t tile_footprint(const tile& t) {
+      return sizeof(tile) + t.texels.size() * sizeof(float);
+    }
+
+    static shared_ptr<const tile> decode(
+        const Tiled_Image& image, int level, int tx, int ty
+    ) {
+      auto t = make_shared<tile>();
+      t->size = image.tile_size();
+      t->texels.resize(image.tile_bytes());
+
+      // every byte value decodes the same, so through a table
+      static const auto linear = [] {
+        std::array<float, 256> table;
+        for (int b = 0; b < 256; ++b) {
+          unsigned char rgb[3] = { static_cast<unsigned char>(b), 0, 0 };
+          table[b] = static_cast<float>(Tiled_Image::decode(rgb).x());
+        }
+        return table;
+      }();
+
+      auto src = image.tile_texels(level, tx, ty);
+      for (size_t k = 0; k < image.tile_bytes(); ++k) {
+        t->texels[k] = linear[src[k]];
+      }
+      image.release(level, tx, ty);
+      return t;
+    }
+
+    // drop least recently used tiles until we're within capacity (always
+    // keeping the newest)
+    void evict() {
+      while (bytes > capacity && lru.size() > 1) {
+        bytes -= tile_footprint(*lru.back().second);
+        index.erase(lru.back().first);
+        lru.pop_back();
+        ++evictions;
+      }
+    }
+
+  // FIELDS //
+  private:
+    mutable std::mutex mtx;
+
+    // open images by path
+    std::map<std::string, std::weak_ptr<Tiled_Image>> images;
+
+    // cached tiles, most recently used first
+    std::list<entry> lru;
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> index;
+
+    size_t capacity;
+    size_t bytes = 0;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+};
+
+#endif
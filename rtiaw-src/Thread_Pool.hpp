@@ -0,0 +1,102 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running tasks off a shared priority queue.
+//
+// Higher priority tasks run first; tasks of equal priority run in the order
+// they were submitted.
+class Thread_Pool {
+  public:
+    // CONSTRUCTORS //
+    explicit Thread_Pool(int n_threads) {
+      if (n_threads < 1) {
+        n_threads = 1;
+      }
+      for (int t = 0; t < n_threads; ++t) {
+        workers.emplace_back(&Thread_Pool::work, this);
+      }
+    }
+
+    // finish all queued tasks, then stop the workers
+    ~Thread_Pool() {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+      }
+      cv.notify_all();
+      for (auto& w : workers) {
+        w.join();
+      }
+    }
+
+    Thread_Pool(const Thread_Pool&) = delete;
+    Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+    // METHODS //
+
+    // queue `fn` to run on one of the workers
+    void submit(int priority, std::function<void()> fn) {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push({ priority, next_seq++, std::move(fn) });
+      }
+      cv.notify_one();
+    }
+
+    int size() const {
+      return static_cast<int>(workers.size());
+    }
+
+  private:
+    struct task {
+      int priority;
+      long seq;
+      std::function<void()> fn;
+    };
+
+    // orders the queue so its top is the highest priority, oldest task
+    struct task_order {
+      bool operator()(const task& a, const task& b) const {
+        if (a.priority != b.priority) {
+          return a.priority < b.priority;
+        }
+        return a.seq > b.seq;
+      }
+    };
+
+    // worker thread: run tasks until stopped and out of work
+    void work() {
+      while (true) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+          return;
+        }
+
+        auto fn = std::move(const_cast<task&>(tasks.top()).fn);
+        tasks.pop();
+        lock.unlock();
+
+        fn();
+      }
+    }
+
+  // FIELDS //
+  private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::priority_queue<task, std::vector<task>, task_order> tasks;
+    long next_seq = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include "RTWeekend.hpp"
+
+#include "Colour.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A mip-mapped texture image, kept on disk in tiles.
+//
+// The file is mapped into memory rather than read, so opening even a huge
+// texture costs nothing: only the pages of the tiles a render actually samples
+// are ever paged in (see `Texture_Cache`, which decodes them and lets the
+// kernel drop the pages again).
+//
+// TEXTURE FILES //
+//
+// In the machine's byte order:
+//
+//   "RTTEX1\n\0"                              8 bytes
+//   tile size, number of levels               uint32 each
+//   per level: width, height                  uint32 each
+//              offset of its tiles            uint64
+//
+// followed by the levels, from full resolution (level 0) halving down to 1x1,
+// each starting on a 64 KiB boundary (a page boundary on any machine, so the
+// pages of one level's tiles aren't shared with the one before; readers
+// don't rely on it, though). A level is a row-major grid of tiles, and
+// a tile is tile size x tile size RGB texels, 3 bytes each, gamma-encoded like
+// a PPM. Tiles on the right and bottom edges are padded by repeating the last
+// texel.
+class Tiled_Image {
+  public:
+    // CONSTRUCTORS //
+    Tiled_Image() : id(next_id++) {}
+
+    ~Tiled_Image() {
+      if (map != MAP_FAILED) {
+        munmap(map, map_size);
+      }
+    }
+
+    Tiled_Image(const Tiled_Image&) = delete;
+    Tiled_Image& operator=(const Tiled_Image&) = delete;
+
+    // map a texture file; false if it can't be mapped or is malformed
+    bool open(const std::string& path) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return false;
+      }
+      struct stat st;
+      if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(header_size(0))) {
+        close(fd);
+        return false;
+      }
+
+      map_size = st.st_size;
+      map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (map == MAP_FAILED) {
+        return false;
+      }
+      return parse();
+    }
+
+    // ACCESSORS //
+
+    int n_levels() const {
+      return static_cast<int>(levels.size());
+    }
+
+    int tile_size() const {
+      return tile;
+    }
+
+    int width(int level) const {
+      return levels[level].width;
+    }
+
+    int height(int level) const {
+      return levels[level].height;
+    }
+
+    int tiles_x(int level) const {
+      return (levels[level].width + tile - 1) / tile;
+    }
+
+    int tiles_y(int level) const {
+      return (levels[level].height + tile - 1) / tile;
+    }
+
+    size_t tile_bytes() const {
+      return static_cast<size_t>(tile) * tile * 3;
+    }
+
+    // the first level no larger than `max_size` texels across
+    int level_for(int max_size) const {
+      int level = 0;
+      while (level + 1 < n_levels()
+             && std::max(width(level), height(level)) > max_size) {
+        ++level;
+      }
+      return level;
+    }
+
+    // the texels of a tile, straight from the mapping
+    const unsigned char* tile_texels(int level, int tx, int ty) const {
+      size_t k = static_cast<size_t>(ty) * tiles_x(level) + tx;
+      return static_cast<const unsigned char*>(map) + levels[level].offset
+        + k * tile_bytes();
+    }
+
+    // let the kernel drop the pages of a tile we're done with (they're paged
+    // back in from the file if touched again)
+    void release(int level, int tx, int ty) const {
+      const long page = sysconf(_SC_PAGESIZE);
+      auto start = reinterpret_cast<uintptr_t>(tile_texels(level, tx, ty));
+      auto end = start + tile_bytes();
+      // only the pages wholly inside the tile
+      start = (start + page - 1) & ~(page - 1);
+      end &= ~(page - 1);
+      if (start < end) {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+      }
+    }
+
+    // WRITING //
+
+    // Write an image of `w` x `h` gamma-encoded RGB texels (rows top to
+    // bottom, like a PPM) as a texture file, mip-mapping it on the way
+    static bool write(
+        const std::string& path, int w, int h,
+        const std::vector<unsigned char>& rgb, int tile_size = 64
+    ) {
+      // the mip chain, in linear colour
+      std::vector<std::vector<Colour>> chain(1);
+      std::vector<std::pair<int, int>> sizes{ { w, h } };
+      for (size_t k = 0; k < rgb.size(); k += 3) {
+        chain[0].push_back(decode(rgb.data() + k));
+      }
+      while (sizes.back().first > 1 || sizes.back().second > 1) {
+        auto [pw, ph] = sizes.back();
+        int nw = std::max(1, pw / 2), nh = std::max(1, ph / 2);
+        chain.push_back(downsample(chain.back(), pw, ph, nw, nh));
+        sizes.push_back({ nw, nh });
+      }
+
+      // where every level goes
+      int n = static_cast<int>(chain.size());
+      size_t tile_bytes = static_cast<size_t>(tile_size) * tile_size * 3;
+      std::vector<uint64_t> offsets;
+      uint64_t offset = level_align(header_size(n));
+      for (auto [lw, lh] : sizes) {
+        offsets.push_back(offset);
+        size_t n_tiles = static_cast<size_t>((lw + tile_size - 1) / tile_size)
+                       * ((lh + tile_size - 1) / tile_size);
+        offset = level_align(offset + n_tiles * tile_bytes);
+      }
+
+      std::ofstream out(path, std::ios::binary);
+      out.write(magic, sizeof(magic));
+      put32(out, tile_size);
+      put32(out, n);
+      for (int l = 0; l < n; ++l) {
+        put32(out, sizes[l].first);
+        put32(out, sizes[l].second);
+        out.write(reinterpret_cast<const char*>(&offsets[l]), sizeof(offsets[l]));
+      }
+
+      std::vector<unsigned char> tile(tile_bytes);
+      for (int l = 0; l < n; ++l) {
+        auto [lw, lh] = sizes[l];
+        pad_to(out, offsets[l]);
+        for (int ty = 0; ty * tile_size < lh; ++ty) {
+          for (int tx = 0; tx * tile_size < lw; ++tx) {
+            for (int y = 0; y < tile_size; ++y) {
+              for (int x = 0; x < tile_size; ++x) {
+                int sx = std::min(tx * tile_size + x, lw - 1);
+                int sy = std::min(ty * tile_size + y, lh - 1);
+                colour_to_bytes(chain[l][static_cast<size_t>(sy) * lw + sx], 1,
+                                &tile[(static_cast<size_t>(y) * tile_size + x) * 3]);
+              }
+            }
+            out.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+          }
+        }
+      }
+      pad_to(out, offset);
+      return static_cast<bool>(out);
+    }
+
+    // linear colour of a gamma-encoded texel (the inverse of `colour_to_bytes`)
+    static Colour decode(const unsigned char rgb[3]) {
+      Colour c;
+      for (int k = 0; k < 3; ++k) {
+        auto g = (rgb[k] + 0.5) / 256;
+        c[k] = g * g;
+      }
+      return c;
+    }
+
+  private:
+    struct level_info {
+      int width, height;
+      uint64_t offset;
+    };
+
+    static size_t header_size(int n) {
+      return sizeof(magic) + 2 * 4 + n * (2 * 4 + 8);
+    }
+
+    // (a fixed alignment, not the page size of the machine writing the file,
+    //  so files open anywhere)
+    static uint64_t level_align(uint64_t n) {
+      const uint64_t align = 64 << 10;
+      return (n + align - 1) / align * align;
+    }
+
+    static void put32(std::ofstream& out, int n) {
+      uint32_t n32 = n;
+      out.write(reinterpret_cast<const char*>(&n32), sizeof(n32));
+    }
+
+    static void pad_to(std::ofstream& out, uint64_t offset) {
+      while (static_cast<uint64_t>(out.tellp()) < offset) {
+        out.put(0);
+      }
+    }
+
+    // box-filter a `w` x `h` level down to `nw` x `nh`
+    static std::vector<Colour> downsample(
+        const std::vector<Colour>& src, int w, int h, int nw, int nh
+    ) {
+      std::vector<Colour> dst;
+      dst.reserve(static_cast<size_t>(nw) * nh);
+      for (int y = 0; y < nh; ++y) {
+        for (int x = 0; x < nw; ++x) {
+          Colour sum(0, 0, 0);
+          for (int k = 0; k < 4; ++k) {
+            int sx = std::min(2 * x + (k & 1), w - 1);
+            int sy = std::min(2 * y + (k >> 1), h - 1);
+            sum += src[static_cast<size_t>(sy) * w + sx];
+          }
+          dst.push_back(sum / 4);
+        }
+      }
+      return dst;
+    }
+
+    // read and check the header and level table of the mapping
+    bool parse() {
+      auto bytes = static_cast<const unsigned char*>(map);
+      uint32_t ts, n;
+      if (memcmp(bytes, magic, sizeof(magic))) {
+        return false;
+      }
+      memcpy(&ts, bytes + sizeof(magic), 4);
+      memcpy(&n, bytes + sizeof(magic) + 4, 4);
+      if (ts == 0 || ts > 4096 || n == 0 || n > 32 || map_size < header_size(n)) {
+        return false;
+      }
+      tile = ts;
+
+      auto p = bytes + header_size(0);
+      for (uint32_t l = 0; l < n; ++l, p += 16) {
+        uint32_t w, h;
+        level_info info;
+        memcpy(&w, p, 4);
+        memcpy(&h, p + 4, 4);
+        memcpy(&info.offset, p + 8, 8);
+        info.width = w;
+        info.height = h;
+
+        // every level is half the previous one, and lies within the file
+        int expect_w = l ? std::max(1, levels.back().width / 2) : info.width;
+        int expect_h = l ? std::max(1, levels.back().height / 2) : info.height;
+        if (w == 0 || h == 0 || w > (1u << 24) || h > (1u << 24)
+            || info.width != expect_w || info.height != expect_h) {
+          return false;
+        }
+        levels.push_back(info);
+        // (in 64 bits, which the size can't overflow given the limits above,
+        //  and without adding to the untrusted offset)
+        uint64_t size = static_cast<uint64_t>(tiles_x(l)) * tiles_y(l) * tile_bytes();
+        if (size > map_size || info.offset > map_size - size) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  // FIELDS //
+  public:
+    // unique per image, to key cached tiles by
+    const uint64_t id;
+
+  private:
+    static constexpr char magic[8] = { 'R', 'T', 'T', 'E', 'X', '1', '\n', '\0' };
+    static inline std::atomic<uint64_t> next_id{ 0 };
+
+    void* map = MAP_FAILED;
+    size_t map_size = 0;
+    int tile = 0;
+    std::vector<level_info> levels;
+};
+
+#endif
@@ -0,0 +1,533 @@
+#include "RTWeekend.hpp"
+
+#include "Hittable_List.hpp"
+#include "BVH.hpp"
+#include "Scene.hpp"
+#include "Scenes.hpp"
+#include "Compact_Scene.hpp"
+#include "Kernel.hpp"
+#include "Framebuffer.hpp"
+#include "Texture.hpp"
+#include "Texture_Cache.hpp"
+#include "Tiled_Image.hpp"
+#include "Camera.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+// HEAP ACCOUNTING //
+//
+// Every allocation of the bench goes through these, so the live heap (as
+// malloc sees it, including its per-allocation overhead) can be measured
+// around building a scene.
+
+// (atomic, as some of the benches allocate from several threads at once;
+//  relaxed, as they're only read once those are done)
+static std::atomic<long> live_bytes{ 0 };
+static std::atomic<long> live_allocs{ 0 };
+
+void* operator new(size_t size) {
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+  live_allocs.fetch_add(1, std::memory_order_relaxed);
+  return p;
+}
+
+// (kept out of line, as GCC otherwise sees through `operator new` and warns
+//  about mismatched `free`s)
+__attribute__((noinline)) static void heap_free(void* p) {
+  live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+  live_allocs.fetch_sub(1, std::memory_order_relaxed);
+  free(p);
+}
+
+void operator delete(void* p) noexcept {
+  if (p) {
+    heap_free(p);
+  }
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+// PERF COUNTERS //
+
+// A hardware counter of the calling thread, through perf_event_open(2).
+// Reads -1 if the kernel (or the sandbox) doesn't let us count.
+class Perf_Counter {
+  public:
+    Perf_Counter(uint32_t type, uint64_t config) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~Perf_Counter() {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+
+    void start() {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+
+    long stop() {
+      uint64_t count;
+      if (fd < 0) {
+        return -1;
+      }
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+      }
+      return static_cast<long>(count);
+    }
+
+  private:
+    int fd;
+};
+
+// seconds elapsed since `start`
+static double seconds_since(bench_clock::time_point start) {
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Shadow-ray throughput: closest-hit `hit` vs. any-hit `occluded`.
+//
+// Primary rays from the final-render camera are traced into `random_scene()`;
+// from every hit point, a shadow ray is cast towards a point light. Both
+// queries are then timed over the exact same set of shadow rays.
+static void bench_shadow_rays(
+    const char* name, const Hittable& world, const Camera& cam) {
+  const int n_primary = 200000;
+  const int repeats = 5;
+  const Point3 light(10, 10, 10);
+
+  // build the set of shadow rays (origin at the hit point, pointing at the
+  // light, so the light sits at t = 1), the same set for every `world`
+  srand(7);
+  std::vector<Ray> shadow_rays;
+  shadow_rays.reserve(n_primary);
+  for (int i = 0; i < n_primary; ++i) {
+    hit_record rec;
+    Ray r = cam.get_ray(random_double(), random_double());
+    if (world.hit(r, 0.001, infinity, rec)) {
+      shadow_rays.push_back(Ray(rec.p, light - rec.p));
+    }
+  }
+
+  // closest-hit path
+  long hit_blocked = 0;
+  auto start = bench_clock::now();
+  for (int k = 0; k < repeats; ++k) {
+    for (const auto& r : shadow_rays) {
+      hit_record rec;
+      hit_blocked += world.hit(r, 0.001, 1.0, rec);
+    }
+  }
+  auto hit_secs = seconds_since(start);
+
+  // any-hit path
+  long occ_blocked = 0;
+  start = bench_clock::now();
+  for (int k = 0; k < repeats; ++k) {
+    for (const auto& r : shadow_rays) {
+      occ_blocked += world.occluded(r, 0.001, 1.0);
+    }
+  }
+  auto occ_secs = seconds_since(start);
+
+  auto n_rays = static_cast<double>(shadow_rays.size()) * repeats;
+  std::cout << "shadow rays (" << name << "): "
+            << shadow_rays.size() << " x " << repeats << '\n'
+            << "  hit      : " << n_rays / hit_secs / 1e6 << " Mrays/s"
+            << " (" << hit_blocked << " blocked)\n"
+            << "  occluded : " << n_rays / occ_secs / 1e6 << " Mrays/s"
+            << " (" << occ_blocked << " blocked)\n"
+            << "  speedup  : " << hit_secs / occ_secs << "x\n";
+
+  if (hit_blocked != occ_blocked) {
+    std::cerr << "MISMATCH between hit and occluded results!\n";
+  }
+}
+
+// Edit-to-first-pixel latency: moving a few spheres of `random_scene()` and
+// refitting the BVH, against rebuilding it from scratch.
+static void bench_scene_edits() {
+  const int n_edits = 1000;
+
+  srand(42);
+  Scene scene(random_scene());
+  int n = scene.size();
+
+  auto start = bench_clock::now();
+  for (int k = 0; k < n_edits; ++k) {
+    // nudge a small sphere (not the ground, id 0) along the ground
+    int id = 1 + k % (n - 4);
+    auto c = scene.sphere(id)->center;
+    scene.move(id, c + Vec3(random_double(-0.05, 0.05), 0, random_double(-0.05, 0.05)));
+  }
+  auto refit_secs = seconds_since(start) / n_edits;
+
+  srand(42);
+  BVH bvh(random_scene());
+  start = bench_clock::now();
+  for (int k = 0; k < n_edits; ++k) {
+    bvh.rebuild();
+  }
+  auto rebuild_secs = seconds_since(start) / n_edits;
+
+  std::cout << "scene edits (" << n << " spheres):\n"
+            << "  move + refit : " << refit_secs * 1e6 << " us/edit"
+            << " (overlap " << scene.accel().overlap() << ", "
+            << scene.accel().rebuild_count() - 1 << " rebuilds)\n"
+            << "  rebuild      : " << rebuild_secs * 1e6 << " us/edit"
+            << " (overlap " << bvh.overlap() << ")\n";
+}
+
+// Tree quality under edits which do wreck it: swapping the places of random
+// pairs of small spheres of `random_scene()`, so that their leaves end up all
+// over the scene. Traces the same primary rays through a BVH which is only
+// ever refit, one which rebuilds itself when it degrades, and a fresh build.
+static void bench_scene_scramble(const Camera& cam) {
+  const int n_swaps = 3000;
+  const int n_rays = 200000;
+
+  srand(42);
+  auto list = random_scene();
+  Scene scene(list);
+  int n = scene.size();
+
+  // the refit-only tree, over the scene's spheres; their handles are their
+  // indices in `list`, like the scene's ids
+  BVH refit_only(list);
+  refit_only.rebuild_overlap = infinity;
+
+  srand(3);
+  for (int k = 0; k < n_swaps; ++k) {
+    // (not the ground, id 0)
+    int a = 1 + static_cast<int>(random_double() * (n - 1));
+    int b = 1 + static_cast<int>(random_double() * (n - 1));
+    auto ca = scene.sphere(a)->center;
+    auto cb = scene.sphere(b)->center;
+    scene.move(a, cb);
+    scene.move(b, ca);
+    refit_only.update(a);
+    refit_only.update(b);
+  }
+
+  BVH fresh(list);
+
+  srand(7);
+  std::vector<Ray> rays;
+  rays.reserve(n_rays);
+  for (int i = 0; i < n_rays; ++i) {
+    rays.push_back(cam.get_ray(random_double(), random_double()));
+  }
+
+  auto trace = [&rays](const char* name, const BVH& bvh, const std::string& note) {
+    long hits = 0;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+      hit_record rec;
+      hits += bvh.hit(r, 0.001, infinity, rec);
+    }
+    auto secs = seconds_since(start);
+    std::cout << "  " << name << rays.size() / secs / 1e6 << " Mrays/s"
+              << " (overlap " << bvh.overlap() << ", SAH cost " << bvh.cost()
+              << note << ", " << hits << " hits)\n";
+  };
+
+  std::cout << "scene scramble (" << n_swaps << " swaps of " << n << " spheres):\n";
+  trace("refit only    : ", refit_only, "");
+  trace("with rebuilds : ", scene.accel(),
+        ", " + std::to_string(scene.accel().rebuild_count() - 1) + " rebuilds");
+  trace("fresh build   : ", fresh, "");
+}
+
+// Scene layout: a BVH over the `shared_ptr` list `random_scene()` returns
+// (two heap allocations per sphere), against the arena-backed
+// `Compact_Scene`. Measures the heap taken per object, and the time and
+// cache misses of tracing the same primary rays through each.
+static void bench_scene_layout(const Camera& cam) {
+  const int n_rays = 500000;
+
+  // build both, measuring the live heap of each
+  srand(42);
+  long bytes0 = live_bytes, allocs0 = live_allocs;
+  auto list = make_shared<Hittable_List>(random_scene());
+  auto list_bvh = make_shared<BVH>(*list);
+  long list_bytes = live_bytes - bytes0, list_allocs = live_allocs - allocs0;
+
+  bytes0 = live_bytes, allocs0 = live_allocs;
+  auto compact = make_shared<Compact_Scene>(*list);
+  long compact_bytes = live_bytes - bytes0, compact_allocs = live_allocs - allocs0;
+
+  // a shared set of primary rays
+  srand(7);
+  std::vector<Ray> rays;
+  rays.reserve(n_rays);
+  for (int i = 0; i < n_rays; ++i) {
+    rays.push_back(cam.get_ray(random_double(), random_double()));
+  }
+
+  // trace them through `world`, reporting the time and counters
+  auto trace = [&rays](const char* name, const Hittable& world,
+                       long bytes, long allocs, size_t n_objects) {
+    Perf_Counter llc_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    Perf_Counter l1d_misses(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    long hits = 0;
+    llc_misses.start();
+    l1d_misses.start();
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+      hit_record rec;
+      hits += world.hit(r, 0.001, infinity, rec);
+    }
+    auto secs = seconds_since(start);
+    long l1d = l1d_misses.stop();
+    long llc = llc_misses.stop();
+
+    std::cout << "  " << name << ":\n"
+              << "    heap        : " << static_cast<double>(bytes) / n_objects
+              << " bytes/object, " << allocs << " allocations\n"
+              << "    traversal   : " << rays.size() / secs / 1e6 << " Mrays/s"
+              << " (" << hits << " hits)\n";
+    if (l1d < 0 && llc < 0) {
+      std::cout << "    cache misses: (perf counters unavailable)\n";
+    }
+    else {
+      std::cout << "    cache misses: " << static_cast<double>(l1d) / rays.size()
+                << " L1d, " << static_cast<double>(llc) / rays.size()
+                << " LLC per ray\n";
+    }
+  };
+
+  std::cout << "scene layout (" << list->objects.size() << " objects):\n";
+  trace("shared_ptr list + BVH", *list_bvh, list_bytes, list_allocs, list->objects.size());
+  trace("arena Compact_Scene  ", *compact, compact_bytes, compact_allocs, compact->size());
+}
+
+// Render kernels: the same small image rendered with `Generic_Sampler` and
+// with the kernel `with_kernel` picks, through a thin-lens and a pinhole
+// camera. Thin-lens images must come out identical.
+static void bench_kernels() {
+  const int width = 150, height = 100, spp = 8, max_depth = 50;
+  const int repeats = 5;
+
+  srand(42);
+  Kernel_Scene scene(random_scene());
+
+  std::cout << "render kernels (" << width << 'x' << height << ", "
+            << spp << " spp):\n";
+
+  for (double aperture : { 0.1, 0.0 }) {
+    Camera cam(Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0),
+               20, 3.0 / 2.0, aperture, 10.0);
+
+    // render single-threaded with whatever sampler `with_kernel` hands
+    // over, keeping the best time of a few runs
+    auto render = [&](bool generic, Framebuffer& fb, double& secs) {
+      return with_kernel(scene, cam, max_depth, generic,
+          [&](const auto& sample) {
+            for (int k = 0; k < repeats; ++k) {
+              fb = Framebuffer(width, height);
+              auto start = bench_clock::now();
+              render_rows(sample, fb, 0, height, spp);
+              auto t = seconds_since(start);
+              secs = k == 0 || t < secs ? t : secs;
+            }
+          });
+    };
+
+    Framebuffer generic_fb(width, height), kernel_fb(width, height);
+    double generic_secs, kernel_secs;
+    render(true, generic_fb, generic_secs);
+    auto name = render(false, kernel_fb, kernel_secs);
+
+    auto n_samples = static_cast<double>(width) * height * spp;
+    std::cout << "  " << (aperture > 0 ? "thin lens" : "pinhole  ") << ":\n"
+              << "    generic : " << n_samples / generic_secs / 1e6 << " Msamples/s\n"
+              << "    " << name << " : "
+              << n_samples / kernel_secs / 1e6 << " Msamples/s\n"
+              << "    speedup : " << generic_secs / kernel_secs << "x\n";
+
+    // the pinhole kernel draws no lens samples, so only thin lens compares
+    // (bit for bit only without FMA contraction: with e.g. -march=native,
+    //  inlining lets the compiler fuse differently in either)
+    if (aperture > 0 && memcmp(generic_fb.sums.data(), kernel_fb.sums.data(),
+                               generic_fb.sums.size() * sizeof(Colour))) {
+      std::cerr << "MISMATCH between generic and specialised kernels!\n";
+    }
+  }
+}
+
+// Texture cache: the ground's texels for the primary rays of a render, looked
+// up in scanline order through tile caches of several sizes, against the
+// memory an eagerly decoded copy of the texture would take.
+static void bench_texture_cache(const Camera& cam) {
+  const int size = 2048;
+  const int width = 600, height = 400;
+
+  // a synthetic texture, written to a temporary texture file
+  std::vector<unsigned char> rgb(static_cast<size_t>(size) * size * 3);
+  for (size_t k = 0; k < rgb.size(); ++k) {
+    rgb[k] = static_cast<unsigned char>((k * 2654435761u) >> 24);
+  }
+  char path[] = "/tmp/rtiaw-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    std::cerr << "Could not create a temporary texture file\n";
+    return;
+  }
+  close(fd);
+  Tiled_Image::write(path, size, size, rgb);
+
+  // where the primary rays hit the ground (the plane y = 0, near enough)
+  srand(7);
+  std::vector<Point3> hits;
+  for (int j = height - 1; j >= 0; --j) {
+    for (int i = 0; i < width; ++i) {
+      Ray r = cam.get_ray((i + random_double()) / (width - 1),
+                          (j + random_double()) / (height - 1));
+      if (r.direction().y() < 0) {
+        hits.push_back(r.at(-r.origin().y() / r.direction().y()));
+      }
+    }
+  }
+
+  std::cout << "texture cache (" << size << 'x' << size << " texture, "
+            << hits.size() << " lookups):\n"
+            << "  eager decode       : "
+            << static_cast<double>(size) * size * 3 * sizeof(float) / (1 << 20)
+            << " MiB\n";
+
+  auto run = [&](size_t capacity_mb, bool mip) {
+    auto cache = make_shared<Texture_Cache>(capacity_mb << 20);
+    auto image = cache->open(path);
+    int level = mip ? image->level_for(width) : 0;
+    Planar_Texture tex(make_shared<Image_Texture>(cache, image, level), 10.0);
+
+    double sum = 0;
+    auto start = bench_clock::now();
+    for (const auto& p : hits) {
+      sum += tex.value(0, 0, p).x();
+    }
+    auto secs = seconds_since(start);
+
+    auto st = cache->stats();
+    std::cout << "  " << capacity_mb << " MiB cache, level " << level
+              << (capacity_mb < 10 ? " : " : ": ")
+              << hits.size() / secs / 1e6 << " Mlookups/s, "
+              << 100.0 * st.hits / (st.hits + st.misses) << "% hits, "
+              << st.evictions << " evictions"
+              << " (checksum " << sum / hits.size() << ")\n";
+  };
+  for (size_t mb : { 1, 4, 16, 64 }) {
+    run(mb, false);
+  }
+  run(4, true);
+
+  // the same lookups from several threads sharing a 64 MiB cache, taking
+  // bands of them in turn like the server's workers do; also counts how many
+  // went through the cache (and its lock)
+  auto run_threads = [&](int n_threads) {
+    auto cache = make_shared<Texture_Cache>(64 << 20);
+    auto image = cache->open(path);
+    Planar_Texture tex(make_shared<Image_Texture>(cache, image), 10.0);
+
+    const size_t band = 4096;
+    std::atomic<size_t> next_band{ 0 };
+    std::vector<double> sums(n_threads, 0.0);
+    std::vector<std::thread> threads;
+    auto start = bench_clock::now();
+    for (int t = 0; t < n_threads; ++t) {
+      threads.emplace_back([&, t] {
+        size_t b;
+        while ((b = next_band.fetch_add(band)) < hits.size()) {
+          for (size_t k = b; k < std::min(b + band, hits.size()); ++k) {
+            sums[t] += tex.value(0, 0, hits[k]).x();
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    auto secs = seconds_since(start);
+
+    double sum = 0;
+    for (auto s : sums) {
+      sum += s;
+    }
+    auto st = cache->stats();
+    auto name = std::to_string(n_threads) + (n_threads > 1 ? " threads" : " thread");
+    name.resize(19, ' ');
+    std::cout << "  " << name << ": " << hits.size() / secs / 1e6 << " Mlookups/s, "
+              << static_cast<double>(st.hits + st.misses) / hits.size()
+              << " cache lookups each (checksum " << sum / hits.size() << ")\n";
+  };
+  for (int n_threads : { 1, 4, 16 }) {
+    run_threads(n_threads);
+  }
+
+  unlink(path);
+}
+
+int main() {
+  // fixed seed, so the scene and rays are the same every run
+  srand(42);
+
+  Hittable_List world = random_scene();
+
+  // same camera as the final render
+  Camera cam(Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0),
+             20, 3.0 / 2.0, 0.1, 10.0);
+
+  bench_shadow_rays("list", world, cam);
+  bench_shadow_rays("BVH", BVH(world), cam);
+
+  bench_scene_edits();
+
+  bench_scene_scramble(cam);
+
+  bench_scene_layout(cam);
+
+  bench_kernels();
+
+  bench_texture_cache(cam);
+}
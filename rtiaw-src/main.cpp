@@ -2,140 +2,191 @@
 
 #include "Colour.hpp"
 #include "Hittable_List.hpp"
+#include "Kernel.hpp"
 #include "Sphere.hpp"
+#include "Scenes.hpp"
 #include "Camera.hpp"
 #include "Material.hpp"
-
+#include "Texture.hpp"
+#include "Texture_Cache.hpp"
+#include "Framebuffer.hpp"
+#include "Preview.hpp"
+#include "Render.hpp"
+#include "Server.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-
-// colour of the given ray
-Colour ray_colour(const Ray& r, const Hittable& world, int depth) {
-  hit_record rec;
-
-  // if we hit the depth limit, the ray was absorbed
-  if (depth <= 0) {
-    return Colour(0, 0, 0);
-  }
-
-  // checking for hits at 0.001 to account for floating-point approximations
-  if (world.hit(r, 0.001, infinity, rec)) {
-    Ray scattered;
-    Colour attenuation;
-    // check if the material scatters the ray
-    if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
-      // if it scattered, handle that and attenuate the colour accordingly
-      return attenuation * ray_colour(scattered, world, depth - 1);
-    }
-    // absorb the ray if it didn't scatter
-    return Colour(0, 0, 0);
-  }
-
-  Vec3 unit_direction = unit_vector(r.direction());
-  auto t = 0.5 * (unit_direction.y() + 1.0);
-  return (1.0 - t) * Colour(1.0, 1.0, 1.0) + t * Colour(0.5, 0.7, 1.0);
+#include <memory>
+#include <string>
+
+// print the command-line usage to stderr
+void usage(const char* prog) {
+  std::cerr
+    << "Usage: " << prog << " [options] > image.ppm\n"
+    << "\n"
+    << "Options:\n"
+    << "  --serve -|PATH          run as a render server, taking jobs from stdin\n"
+    << "                          (-) or from a Unix socket at PATH\n"
+    << "  --threads N             server worker threads (default: all cores)\n"
+    << "  --spp N                 samples per pixel (default 500)\n"
+    << "  --spp-offset N          number the samples from N (default 0), so that\n"
+    << "                          renders to be added up with `merge --add` take\n"
+    << "                          different samples\n"
+    << "  --deadline SEC          render progressive passes for at most SEC\n"
+    << "                          seconds (and at most --spp samples per pixel)\n"
+    << "  --crop X,Y,W,H          only render the W x H pixels at (X, Y), counted\n"
+    << "                          from the top-left corner of the image\n"
+    << "  --save-acc PATH         save the accumulation buffer to PATH, for\n"
+    << "                          merging crops with `merge`\n"
+    << "  --preview PATH          publish progressive P6 frames to PATH\n"
+    << "                          (e.g. a named pipe made with `mkfifo`)\n"
+    << "  --preview-fd FD         publish progressive P6 frames to an open FD\n"
+    << "  --preview-interval SEC  seconds between preview frames (default 1)\n"
+    << "  --preview-scale N       downsample preview frames by N (default 1)\n"
+    << "  --ground checker|PATH   texture the ground with a checkerboard, or with\n"
+    << "                          a texture file made by `mktex` (from the mip\n"
+    << "                          level fitting its size on screen)\n"
+    << "  --texture-cache MB      memory for decoded texture tiles, also of the\n"
+    << "                          server (default 64)\n"
+    << "  --kernel auto|generic   render with a specialised kernel when one fits\n"
+    << "                          the scene and camera (default), or always with\n"
+    << "                          the generic one\n";
 }
 
-// return the scene used for development
-Hittable_List dev_scene() {
-  Hittable_List world;
-
-  auto material_ground = make_shared<Lambertian>(Colour(0.8, 0.8, 0.0));
-  auto material_center = make_shared<Lambertian>(Colour(0.1, 0.2, 0.5));
-  auto material_left   = make_shared<Dielectric>(1.5);
-  auto material_right  = make_shared<Metal>(Colour(0.8, 0.6, 0.2), 0.0);
-
-  // the ground is round
-  world.add(make_shared<Sphere>(Point3(0, -100.5, -1), 100, material_ground));
-  // pondering my orbs
-  world.add(make_shared<Sphere>(Point3( 0, 0, -1),  0.5, material_center));
-  world.add(make_shared<Sphere>(Point3(-1, 0, -1),  0.5, material_left));
-  world.add(make_shared<Sphere>(Point3(-1, 0, -1), -0.45, material_left));
-  world.add(make_shared<Sphere>(Point3( 1, 0, -1),  0.5, material_right));
-
-  return world;
-}
-
-// produce a scene with lots of random spheres
-Hittable_List random_scene() {
-  Hittable_List world;
-
-  // radii
-  auto ground_radius = 1000.0;
-  auto small_radius  = 0.2;
-  auto big_radius    = 1.0;
-
-  // the ground is (still) round
-  auto ground_material = make_shared<Lambertian>(Colour(0.5, 0.5, 0.5));
-  world.add(make_shared<Sphere>(Point3(0, -1000, 0), ground_radius, ground_material));
-
-
-  // generate a bunch of random small spheres
-  for (int a = -11; a < 11; a++) {
-    for (int b = -11; b < 11; b++) {
-      auto choose_mat = random_double();
-
-      // random center for the sphere
-      Point3 center(
-          a + 0.9 * random_double(),
-          0.2,
-          b + 0.9 * random_double()
-          );
-
-      // make sure the spheres are at least a bit in the camera view
-      if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
-        shared_ptr<Material> sphere_material;
-
-        // determine the randomly picked material
-        if (choose_mat < 0.8) {
-          // diffuse (80% likely)
-          auto albedo = Colour::random() * Colour::random();
-          sphere_material = make_shared<Lambertian>(albedo);
-        }
-        else if (choose_mat < 0.95) {
-          // metal (15% likely)
-          auto albedo = Colour::random(0.5, 1);
-          auto fuzz = random_double(0, 0.5);
-          sphere_material = make_shared<Metal>(albedo, fuzz);
-        }
-        else {
-          // glass (5% likely)
-          sphere_material = make_shared<Dielectric>(1.5);
-        }
+int main(int argc, char* argv[]) {
+
+  // Options
+
+  std::string serve;
+  int n_threads = static_cast<int>(std::thread::hardware_concurrency());
+  int samples_per_pixel = 500;
+  int sample_offset = 0;
+  double deadline = 0;
+  bool crop = false;
+  int crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0;
+  std::string acc_path;
+  std::string preview_path;
+  int preview_fd = -1;
+  double preview_interval = 1.0;
+  int preview_scale = 1;
+  bool generic_kernel = false;
+  std::string ground;
+  double texture_cache_mb = 64;
+
+  for (int a = 1; a < argc; ++a) {
+    // every option takes exactly one argument
+    if (a + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char* arg = argv[a];
+    const char* val = argv[++a];
 
-        // add a new sphere with the material
-        world.add(make_shared<Sphere>(center, small_radius, sphere_material));
+    if (!strcmp(arg, "--serve")) {
+      serve = val;
+    }
+    else if (!strcmp(arg, "--threads")) {
+      n_threads = atoi(val);
+    }
+    else if (!strcmp(arg, "--spp")) {
+      samples_per_pixel = atoi(val);
+    }
+    else if (!strcmp(arg, "--spp-offset")) {
+      sample_offset = atoi(val);
+    }
+    else if (!strcmp(arg, "--deadline")) {
+      deadline = atof(val);
+    }
+    else if (!strcmp(arg, "--crop")) {
+      crop = sscanf(val, "%d,%d,%d,%d", &crop_x, &crop_y, &crop_w, &crop_h) == 4;
+      if (!crop) {
+        usage(argv[0]);
+        return 1;
       }
     }
+    else if (!strcmp(arg, "--save-acc")) {
+      acc_path = val;
+    }
+    else if (!strcmp(arg, "--preview")) {
+      preview_path = val;
+    }
+    else if (!strcmp(arg, "--preview-fd")) {
+      preview_fd = atoi(val);
+    }
+    else if (!strcmp(arg, "--preview-interval")) {
+      preview_interval = atof(val);
+    }
+    else if (!strcmp(arg, "--preview-scale")) {
+      preview_scale = atoi(val);
+    }
+    else if (!strcmp(arg, "--ground")) {
+      ground = val;
+    }
+    else if (!strcmp(arg, "--texture-cache")) {
+      texture_cache_mb = atof(val);
+    }
+    else if (!strcmp(arg, "--kernel") && !strcmp(val, "auto")) {
+      generic_kernel = false;
+    }
+    else if (!strcmp(arg, "--kernel") && !strcmp(val, "generic")) {
+      generic_kernel = true;
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
   }
 
-  // add 3 big spheres, one of each material type
-  auto material1 = make_shared<Dielectric>(1.5);
-  world.add(make_shared<Sphere>(Point3(0, 1, 0), big_radius, material1));
-
-  auto material2 = make_shared<Lambertian>(Colour(0.4, 0.2, 0.1));
-  world.add(make_shared<Sphere>(Point3(-4, 1, 0), big_radius, material2));
-
-  auto material3 = make_shared<Metal>(Colour(0.7, 0.6, 0.5), 0.0);
-  world.add(make_shared<Sphere>(Point3(4, 1, 0), big_radius, material3));
-
-  return world;
-}
+  auto texture_cache_bytes = static_cast<size_t>(texture_cache_mb * 1024 * 1024);
 
+  // Server
 
+  if (serve == "-") {
+    Render_Server server(n_threads, texture_cache_bytes);
+    server.serve_stream(std::cin, std::cout);
+    return 0;
+  }
+  else if (!serve.empty()) {
+    Render_Server server(n_threads, texture_cache_bytes);
+    if (!server.serve_socket(serve)) {
+      std::cerr << "Could not listen on " << serve << '\n';
+      return 1;
+    }
+    return 0;
+  }
 
-int main() {
+  if (samples_per_pixel <= 0) {
+    std::cerr << "Need at least one sample per pixel.\n";
+    return 1;
+  }
+  if (sample_offset < 0) {
+    std::cerr << "The sample offset can't be negative.\n";
+    return 1;
+  }
 
   // Image
 
   const auto aspect_ratio =  3.0 / 2.0;
   const int img_width = 1200;
   const int img_height = static_cast<int>(img_width / aspect_ratio);
-  const int samples_per_pixel = 500;
   const int max_depth = 50;
 
-  // World
-
-  Hittable_List world = random_scene();
+  // the window to render; the crop is given top-down, like the image is
+  // viewed, but the framebuffer counts scanlines bottom-up
+  if (!crop) {
+    crop_w = img_width;
+    crop_h = img_height;
+  }
+  else if (crop_x < 0 || crop_y < 0 || crop_w <= 0 || crop_h <= 0
+           || crop_x + crop_w > img_width || crop_y + crop_h > img_height) {
+    std::cerr << "Crop window must lie within the "
+              << img_width << 'x' << img_height << " image.\n";
+    return 1;
+  }
+  Framebuffer fb(img_width, img_height,
+                 crop_x, img_height - crop_y - crop_h, crop_w, crop_h);
 
   // Camera
 
@@ -147,31 +198,94 @@ int main() {
   auto aperture = 0.1;
   Camera cam(lookFrom, lookAt, vup, vfov, aspect_ratio, aperture, dist_to_focus);
 
+  // World
+
+  auto textures = make_shared<Texture_Cache>(texture_cache_bytes);
+
+  shared_ptr<Texture> ground_texture;
+  if (ground == "checker") {
+    ground_texture = make_shared<Checker_Texture>(
+        Colour(0.2, 0.3, 0.1), Colour(0.9, 0.9, 0.9));
+  }
+  else if (!ground.empty()) {
+    auto image = textures->open(ground);
+    if (!image) {
+      std::cerr << "Could not open the texture " << ground << '\n';
+      return 1;
+    }
+    // one copy of the image every 10 units across the ground, which comes
+    // out about this many pixels across where the camera looks (less further
+    // off): there's no point in reading more texels than that
+    const double repeat = 10.0;
+    auto pixels_per_unit = img_width
+      / (2 * (lookAt - lookFrom).length() * tan(degrees_to_radians(vfov) / 2));
+    int level = image->level_for(static_cast<int>(repeat * pixels_per_unit));
+    std::cerr << "Texturing the ground with level " << level << " ("
+              << image->width(level) << 'x' << image->height(level)
+              << ") of " << ground << ".\n";
+
+    ground_texture = make_shared<Planar_Texture>(
+        make_shared<Image_Texture>(textures, image, level), repeat);
+  }
+
+  Kernel_Scene world(random_scene(ground_texture));
+
+  // Preview
+
+  std::unique_ptr<Preview> preview;
+  if (!preview_path.empty()) {
+    preview = std::make_unique<Preview>(preview_path, preview_interval, preview_scale);
+  }
+  else if (preview_fd >= 0) {
+    preview = std::make_unique<Preview>(preview_fd, preview_interval, preview_scale);
+  }
+
   // Render
 
-  std::cout << "P3\n" << img_width << ' ' << img_height << "\n255\n";
+  // progress to report with the final preview frame
+  int passes_done = fb.height, passes_total = fb.height;
+
+  auto kernel = with_kernel(world, cam, max_depth, generic_kernel,
+      [&](const auto& sample) {
+        if (deadline > 0) {
+          long taken = render_until(sample, fb, deadline, samples_per_pixel,
+                                    preview.get(), sample_offset);
+          std::cerr << '\n' << "Achieved "
+                    << static_cast<double>(taken) / (fb.width * fb.height)
+                    << " samples per pixel.";
+          passes_done = static_cast<int>(taken / (static_cast<long>(fb.width) * fb.height));
+          passes_total = samples_per_pixel;
+        }
+        else {
+          render_scanlines(sample, fb, samples_per_pixel, preview.get(),
+                           sample_offset);
+        }
+      });
+  std::cerr << '\n' << "Rendered with the " << kernel << " kernel.";
+
+  auto tex = textures->stats();
+  if (tex.hits + tex.misses > 0) {
+    std::cerr << '\n' << "Texture cache: " << tex.hits << " hits, "
+              << tex.misses << " misses, " << tex.evictions << " evictions, "
+              << tex.bytes / 1024 << " of " << tex.capacity / 1024 << " KiB used.";
+  }
+
+  fb.write_ppm(std::cout);
 
-  for (int j = img_height - 1; j >= 0; --j) {
-    // progress indicator
-    std::cerr << '\r' << "Scanlines remaining: " << j << ' ' << std::flush;
-    for (int i = 0; i < img_width; ++i) {
-      // initial colour is black
-      Colour pixel_colour(0, 0, 0);
-      // Anti-Aliasing
-      for (int s = 0; s < samples_per_pixel; ++s) {
-        // horizontal and vertical components of ray on screen
-        auto u = (i + random_double()) / (img_width - 1);
-        auto v = (j + random_double()) / (img_height - 1);
+  std::cout.flush();
 
-        Ray r = cam.get_ray(u, v);
+  if (!acc_path.empty() && !fb.save(acc_path)) {
+    std::cerr << '\n' << "Could not save the accumulation buffer to "
+              << acc_path << '\n';
+    return 1;
+  }
 
-        pixel_colour += ray_colour(r, world, max_depth);
-      }
-      write_colour(std::cout, pixel_colour, samples_per_pixel);
-    }
+  // only now that the image is out, give the viewer (a little while for)
+  // the final frame
+  if (preview && !preview->finish(fb, passes_done, passes_total)) {
+    std::cerr << '\n' << "The viewer didn't take the final preview frame.";
   }
 
   // end of progress indicator
   std::cerr << '\n' << "Done.\n";
 }
-
@@ -0,0 +1,88 @@
+#include "RTWeekend.hpp"
+
+#include "Framebuffer.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Paste crop renders into an existing accumulation buffer.
+//
+// Re-rendering part of the image (`main --crop ... --save-acc crop.acc`) then
+// only costs the area of the crop: `merge` replaces those pixels of the full
+// buffer (`main --save-acc full.acc`) with the new ones, in place.
+//
+// With `--add`, the crops' samples are added to the buffer's instead, to
+// refine it. Every render numbers its samples from 0 unless told otherwise,
+// so the crops must be rendered with an `--spp-offset` past the samples
+// already in the buffer (e.g. `--spp-offset 500` on top of 500 spp): adding
+// the same samples twice only doubles the count, not the quality.
+
+// print the command-line usage to stderr
+void usage(const char* prog) {
+  std::cerr
+    << "Usage: " << prog << " [options] BASE.acc CROP.acc...\n"
+    << "\n"
+    << "Pastes every CROP into BASE, overwriting BASE.\n"
+    << "\n"
+    << "Options:\n"
+    << "  --add        add the crops' samples to BASE instead of replacing;\n"
+    << "               the crops must be rendered with an --spp-offset past\n"
+    << "               BASE's samples, or they only repeat them\n"
+    << "  --ppm PATH   also write the merged image to PATH\n";
+}
+
+int main(int argc, char* argv[]) {
+  bool accumulate = false;
+  std::string ppm_path;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-'; ++a) {
+    if (!strcmp(argv[a], "--add")) {
+      accumulate = true;
+    }
+    else if (!strcmp(argv[a], "--ppm") && a + 1 < argc) {
+      ppm_path = argv[++a];
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // need a base and at least one crop
+  if (argc - a < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string base_path = argv[a++];
+  Framebuffer base;
+  if (!base.load(base_path)) {
+    std::cerr << "Could not load " << base_path << '\n';
+    return 1;
+  }
+
+  for (; a < argc; ++a) {
+    Framebuffer crop;
+    if (!crop.load(argv[a])) {
+      std::cerr << "Could not load " << argv[a] << '\n';
+      return 1;
+    }
+    if (!base.paste(crop, accumulate)) {
+      std::cerr << argv[a] << " doesn't fit within " << base_path << '\n';
+      return 1;
+    }
+  }
+
+  if (!base.save(base_path)) {
+    std::cerr << "Could not save " << base_path << '\n';
+    return 1;
+  }
+
+  if (!ppm_path.empty()) {
+    std::ofstream out(ppm_path);
+    base.write_ppm(out);
+  }
+}
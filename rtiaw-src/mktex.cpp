@@ -0,0 +1,81 @@
+#include "RTWeekend.hpp"
+
+#include "Tiled_Image.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Convert a PPM image into a tiled, mip-mapped texture file (see
+// `Tiled_Image`), for `Image_Texture`s to page in from.
+
+// print the command-line usage to stderr
+void usage(const char* prog) {
+  std::cerr
+    << "Usage: " << prog << " [options] IN.ppm OUT.rttex\n"
+    << "\n"
+    << "Options:\n"
+    << "  --tile N   tile size in texels (default 64)\n";
+}
+
+// read a P3 or P6 PPM with a maximum value of 255; false if it isn't one
+bool read_ppm(const std::string& path, int& w, int& h, std::vector<unsigned char>& rgb) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int maxval;
+  in >> magic >> w >> h >> maxval;
+  if (!in || (magic != "P3" && magic != "P6") || maxval != 255
+      || w <= 0 || h <= 0 || w > (1 << 24) || h > (1 << 24)) {
+    return false;
+  }
+
+  rgb.resize(static_cast<size_t>(w) * h * 3);
+  if (magic == "P6") {
+    // a single whitespace character separates the header from the texels
+    in.get();
+    in.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+  }
+  else {
+    for (auto& c : rgb) {
+      int v;
+      in >> v;
+      c = static_cast<unsigned char>(v);
+    }
+  }
+  return static_cast<bool>(in);
+}
+
+int main(int argc, char* argv[]) {
+  int tile_size = 64;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-'; ++a) {
+    if (!strcmp(argv[a], "--tile") && a + 1 < argc) {
+      tile_size = atoi(argv[++a]);
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - a != 2 || tile_size <= 0 || tile_size > 4096) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int w, h;
+  std::vector<unsigned char> rgb;
+  if (!read_ppm(argv[a], w, h, rgb)) {
+    std::cerr << "Could not read " << argv[a] << " (need a P3 or P6 PPM, maxval 255)\n";
+    return 1;
+  }
+
+  if (!Tiled_Image::write(argv[a + 1], w, h, rgb, tile_size)) {
+    std::cerr << "Could not write " << argv[a + 1] << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,120 @@
+#include "RTWeekend.hpp"
+
+#include "Server.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Checks of the render server, talking to it over its Unix socket like
+// clients would. Exits non-zero if any of them fails.
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+  std::cout << (ok ? "ok   " : "FAIL ") << what << '\n';
+  if (!ok) {
+    ++failures;
+  }
+}
+
+// a socket client of the server, one request or reply per line
+class Client {
+  public:
+    explicit Client(const std::string& path) {
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+      // the server may not be listening yet
+      for (int tries = 0; tries < 100; ++tries) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+          return;
+        }
+        close(fd);
+        fd = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    }
+
+    ~Client() {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+
+    void send_line(const std::string& line) {
+      auto msg = line + '\n';
+      auto n = send(fd, msg.data(), msg.size(), MSG_NOSIGNAL);
+      (void) n;
+    }
+
+    // the next reply line, or "" if the server hung up
+    std::string read_line() {
+      std::string line;
+      char c;
+      while (recv(fd, &c, 1, 0) == 1) {
+        if (c == '\n') {
+          return line;
+        }
+        line += c;
+      }
+      return line;
+    }
+
+  private:
+    int fd = -1;
+};
+
+// Two clients editing the same sphere while a job holds up the edits: the
+// second edit must see what the first one did, not the scene from before
+static void test_concurrent_edits(const std::string& path) {
+  Client job(path), remover(path), mover(path);
+
+  job.send_line("render id=j1 out=/tmp/rtiaw-test-j1.ppm width=120 spp=20");
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // waits for j1
+  remover.send_line("remove id=5");
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // waits for j1, then for the removal
+  mover.send_line("move id=5 center=1,1,1");
+
+  check(job.read_line().compare(0, 8, "done j1 ") == 0, "job done");
+  check(remover.read_line() == "ok 5", "first client removes sphere 5");
+  check(mover.read_line() == "error - no such sphere",
+        "second client can't move the removed sphere");
+  unlink("/tmp/rtiaw-test-j1.ppm");
+}
+
+static void test_unknown_command(const std::string& path) {
+  Client client(path);
+  client.send_line("bogus");
+  check(client.read_line() == "error - unknown command 'bogus'",
+        "unknown command");
+}
+
+int main() {
+  std::string path = "/tmp/rtiaw-test-" + std::to_string(getpid()) + ".sock";
+
+  Render_Server server(2);
+  std::thread serving([&server, &path] {
+    if (!server.serve_socket(path)) {
+      check(false, "listen on " + path);
+    }
+  });
+
+  test_concurrent_edits(path);
+  test_unknown_command(path);
+
+  Client(path).send_line("quit");
+  serving.join();
+
+  return failures ? 1 : 0;
+}